@@ -1,8 +1,18 @@
 #include <iostream>
 #include <unordered_map>
 #include <cstring>
+#include <cstdint>
+#include <cstdlib>
 #include <unordered_set>
 #include <cassert>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "maptel.h"
 
 using namespace std;
@@ -14,7 +24,267 @@ namespace {
     const bool debug = true;
 #endif
 
-    using dictionary = unordered_map<string, string>;
+    using changes_map = unordered_map<string, string>;
+
+    // Reports a failed system call and terminates, the C interface has no way to return an error.
+    [[noreturn]] void fail(const string& function, const string& what) {
+        cerr << "maptel: " << function << ": " << what << ": " << strerror(errno) << '\n';
+        abort();
+    }
+
+    /* ----- SHARED MEMORY DICTIONARIES ----- */
+
+    const uint64_t shared_magic = 0x6d617074656c3032; // "maptel02"
+
+    enum slot_state : char { slot_empty = 0, slot_used };
+
+    // The segment stores no pointers, so it can be mapped at any address in every process.
+    struct shared_slot {
+        char state;
+        char src[jnp1::TEL_NUM_MAX_LEN + 1];
+        char dst[jnp1::TEL_NUM_MAX_LEN + 1];
+    };
+
+    struct shared_header {
+        uint64_t magic;
+        // Number of slots, a power of two.
+        uint64_t slots;
+        // Maximal number of changes, at most 3/4 of the slots.
+        uint64_t capacity;
+        // Number of changes, that is of used slots.
+        uint64_t count;
+        // Seqlock counter, odd while the writer modifies the table.
+        atomic<uint64_t> seq;
+    };
+
+    static_assert(atomic<uint64_t>::is_always_lock_free, "the seqlock counter is shared between processes");
+
+    // Open addressing hash table (linear probing) of the number changes placed in a named
+    // POSIX shared memory segment. Only the process that created the segment may modify it,
+    // readers in other processes never block it and retry their reads instead.
+    // Erasing shifts the following changes of the cluster back instead of leaving tombstones,
+    // so the table never fills up with erased slots and probes stay short.
+    class shared_table {
+        public:
+            shared_table(const char *name, size_t capacity) : name(name), owner(true) {
+                uint64_t slots = 2;
+                while (slots < capacity + capacity / 3 + 1) slots *= 2;
+                size = sizeof(shared_header) + slots * sizeof(shared_slot);
+
+                // A segment with the same name may be mapped by readers of another dictionary,
+                // so it is never reused or truncated.
+                int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0644);
+                if (fd < 0) fail(__FUNCTION__, string("shm_open ") + name);
+                if (ftruncate(fd, static_cast<off_t>(size)) != 0) fail(__FUNCTION__, "ftruncate");
+                map(fd, PROT_READ | PROT_WRITE);
+
+                // ftruncate zero-fills the segment, so all of the slots are empty already.
+                header->slots = slots;
+                header->capacity = capacity;
+                header->count = 0;
+                header->seq.store(0, memory_order_relaxed);
+                atomic_thread_fence(memory_order_release);
+                header->magic = shared_magic;
+            }
+
+            explicit shared_table(const char *name) : name(name), owner(false) {
+                int fd = shm_open(name, O_RDONLY, 0);
+                if (fd < 0) fail(__FUNCTION__, string("shm_open ") + name);
+                struct stat st;
+                if (fstat(fd, &st) != 0) fail(__FUNCTION__, "fstat");
+                size = static_cast<size_t>(st.st_size);
+                // The segment may have been created by anything, so it is checked in release builds too.
+                if (size < sizeof(shared_header)) {
+                    close(fd);
+                    errno = EINVAL;
+                    fail(__FUNCTION__, string("segment ") + name + " is not a maptel dictionary");
+                }
+                map(fd, PROT_READ);
+
+                uint64_t slot_count = header->slots;
+                if (header->magic != shared_magic || slot_count == 0 || (slot_count & (slot_count - 1)) != 0
+                    || slot_count != (size - sizeof(shared_header)) / sizeof(shared_slot)
+                    || size != sizeof(shared_header) + slot_count * sizeof(shared_slot)) {
+                    errno = EINVAL;
+                    fail(__FUNCTION__, string("segment ") + name + " is not a maptel dictionary");
+                }
+            }
+
+            shared_table(const shared_table&) = delete;
+            shared_table& operator=(const shared_table&) = delete;
+
+            // Readers that have the segment mapped keep using it after the owner unlinks it.
+            ~shared_table() {
+                munmap(header, size);
+                if (owner) shm_unlink(name.c_str());
+            }
+
+            bool is_owner() const { return owner; }
+
+            void insert(char const *tel_src, char const *tel_dst) {
+                assert(owner);
+                shared_slot *slot = find_slot(tel_src, true);
+                bool fresh = slot == nullptr || slot->state == slot_empty;
+                if (fresh && header->count >= header->capacity) {
+                    errno = ENOSPC;
+                    fail(__FUNCTION__, "shared dictionary " + name + " is full");
+                }
+
+                begin_write();
+                if (fresh) strcpy(slot->src, tel_src);
+                strcpy(slot->dst, tel_dst);
+                slot->state = slot_used;
+                if (fresh) header->count++;
+                end_write();
+            }
+
+            bool erase(char const *tel_src) {
+                assert(owner);
+                shared_slot *slot = find_slot(tel_src, false);
+                if (slot == nullptr) return false;
+
+                begin_write();
+                remove_slot(slot);
+                header->count--;
+                end_write();
+                return true;
+            }
+
+            // Same as traverse, but retried until no write overlapped with the read.
+            // Returns whether the changes form a cycle.
+            bool transform(const string &tel_src, char *tel_dst, [[maybe_unused]] size_t len) const {
+                char result[jnp1::TEL_NUM_MAX_LEN + 1];
+                bool has_cycle;
+                uint64_t before;
+
+                do {
+                    while ((before = header->seq.load(memory_order_acquire)) & 1) { }
+                    has_cycle = read_traverse(tel_src, result);
+                    atomic_thread_fence(memory_order_acquire);
+                } while (header->seq.load(memory_order_relaxed) != before);
+
+                assert(strlen(result) < len);
+                strcpy(tel_dst, result);
+                return has_cycle;
+            }
+
+        private:
+            string name;
+            bool owner;
+            size_t size;
+            shared_header *header;
+            shared_slot *slots;
+
+            void map(int fd, int prot) {
+                void *addr = mmap(nullptr, size, prot, MAP_SHARED, fd, 0);
+                close(fd);
+                if (addr == MAP_FAILED) fail(__FUNCTION__, "mmap");
+                header = static_cast<shared_header*>(addr);
+                slots = reinterpret_cast<shared_slot*>(static_cast<char*>(addr) + sizeof(shared_header));
+            }
+
+            static uint64_t hash(char const *num) {
+                // FNV-1a
+                uint64_t h = 14695981039346656037ULL;
+                for (size_t i = 0; i <= jnp1::TEL_NUM_MAX_LEN && num[i] != '\0'; i++) {
+                    h ^= static_cast<unsigned char>(num[i]);
+                    h *= 1099511628211ULL;
+                }
+                return h;
+            }
+
+            // Returns the slot holding the change of tel_src. If there is none, returns the
+            // empty slot where it should be inserted (for_insert) or nullptr.
+            // Probing is bounded, so torn reads cannot make it loop forever. The owner always
+            // finds an empty slot, as at most 3/4 of the slots are used.
+            shared_slot* find_slot(char const *tel_src, bool for_insert) const {
+                uint64_t mask = header->slots - 1;
+
+                for (uint64_t i = hash(tel_src) & mask, step = 0; step < header->slots; i = (i + 1) & mask, step++) {
+                    shared_slot *slot = &slots[i];
+                    if (slot->state == slot_empty)
+                        return for_insert ? slot : nullptr;
+                    if (strncmp(slot->src, tel_src, jnp1::TEL_NUM_MAX_LEN + 1) == 0)
+                        return slot;
+                }
+                return nullptr;
+            }
+
+            // Empties the slot and moves back the later changes of its cluster whose probes
+            // would otherwise pass through the emptied slot (Knuth's algorithm R).
+            void remove_slot(shared_slot *slot) {
+                uint64_t mask = header->slots - 1;
+                uint64_t hole = static_cast<uint64_t>(slot - slots);
+
+                for (uint64_t i = (hole + 1) & mask; slots[i].state != slot_empty; i = (i + 1) & mask) {
+                    uint64_t home = hash(slots[i].src) & mask;
+                    // The change can move to the hole if its home is not cyclically in (hole, i].
+                    bool movable = hole < i ? home <= hole || home > i : home <= hole && home > i;
+                    if (movable) {
+                        slots[hole] = slots[i];
+                        hole = i;
+                    }
+                }
+                slots[hole].state = slot_empty;
+            }
+
+            void begin_write() {
+                header->seq.store(header->seq.load(memory_order_relaxed) + 1, memory_order_relaxed);
+                atomic_thread_fence(memory_order_release);
+            }
+
+            void end_write() {
+                header->seq.store(header->seq.load(memory_order_relaxed) + 1, memory_order_release);
+            }
+
+            bool read_traverse(const string &tel_src, char *result) const {
+                unordered_set<string> visited;
+                string cur = tel_src;
+
+                while (true) {
+                    visited.insert(cur);
+                    shared_slot *slot = find_slot(cur.c_str(), false);
+                    // No number change for cur
+                    if (slot == nullptr) {
+                        strcpy(result, cur.c_str());
+                        return false;
+                    }
+                    string next(slot->dst, strnlen(slot->dst, jnp1::TEL_NUM_MAX_LEN));
+                    // A cycle found
+                    if (visited.count(next)) {
+                        strcpy(result, tel_src.c_str());
+                        return true;
+                    }
+                    cur = move(next);
+                }
+            }
+    };
+
+    // Marks a sealed number whose changes form a cycle (it transforms into itself).
+    const size_t no_terminal = SIZE_MAX;
+
+    struct dictionary {
+        changes_map changes;
+
+        // Filled by maptel_seal. For every number changed in the dictionary holds the index
+        // in terminals of the number it finally transforms into, or no_terminal.
+        unordered_map<string, size_t> resolved;
+        vector<string> terminals;
+        bool sealed = false;
+
+        // Set for the dictionaries created by maptel_create_shared or maptel_open_shared,
+        // which keep their changes in shared memory instead.
+        unique_ptr<shared_table> shared;
+
+        void unseal() {
+            if (sealed) {
+                resolved.clear();
+                terminals.clear();
+                sealed = false;
+            }
+        }
+    };
+
     using map_of_dictionaries = unordered_map<size_t, dictionary>;
 
     // Size of the map that holds the dictionaries.
@@ -28,7 +298,7 @@ namespace {
 
     // Follows the path of the consecutive number changes (basically DFS on the directed graph).
     // Returns whether the changes form a cycle.
-    bool traverse(dictionary &current_dict, string &tel_src, string &tel_cur, char *tel_dst,
+    bool traverse(changes_map &current_dict, string &tel_src, string &tel_cur, char *tel_dst,
                   size_t len, unordered_set<string> &visited) {
 
         visited.insert(tel_cur);
@@ -53,6 +323,52 @@ namespace {
         }
     }
 
+    // Resolves every chain of changes in one linear pass over the functional graph of the
+    // dictionary. Each walk stops at a number that is already resolved (or in progress),
+    // so every number is visited a constant number of times.
+    void seal(dictionary &dict) {
+        // Numbers on the currently walked path, temporarily marked as in progress.
+        const size_t in_progress = SIZE_MAX - 1;
+        unordered_map<string, size_t> terminal_index;
+        vector<const string*> path;
+
+        dict.unseal();
+        dict.resolved.reserve(dict.changes.size());
+
+        for (auto &change : dict.changes) {
+            if (dict.resolved.count(change.first)) continue;
+
+            const string *cur = &change.first;
+            size_t result;
+            while (true) {
+                auto found_resolved = dict.resolved.find(*cur);
+                if (found_resolved != dict.resolved.end()) {
+                    // Returning to the path forms a cycle, so all of the numbers on the path
+                    // (those on the cycle and those leading into it) transform into themselves.
+                    result = found_resolved->second == in_progress ? no_terminal : found_resolved->second;
+                    break;
+                }
+
+                auto found_change = dict.changes.find(*cur);
+                if (found_change == dict.changes.end()) {
+                    auto inserted = terminal_index.emplace(*cur, dict.terminals.size());
+                    if (inserted.second) dict.terminals.push_back(*cur);
+                    result = inserted.first->second;
+                    break;
+                }
+
+                dict.resolved[*cur] = in_progress;
+                path.push_back(&found_change->first);
+                cur = &found_change->second;
+            }
+
+            for (auto num : path) dict.resolved[*num] = result;
+            path.clear();
+        }
+
+        dict.sealed = true;
+    }
+
     void check_number(char const *num) {
         if (debug) {
             size_t counter = 0;
@@ -127,7 +443,15 @@ void jnp1::maptel_insert(unsigned long id, char const *tel_src, char const *tel_
     check_number(tel_src);
     check_number(tel_dst);
 
-    dictionaries()[id][string(tel_src)] = string(tel_dst);
+    dictionary& dic = dictionaries()[id];
+    if (dic.shared) {
+        dic.shared->insert(tel_src, tel_dst);
+        log(__FUNCTION__, ": inserted");
+        return;
+    }
+
+    dic.unseal();
+    dic.changes[string(tel_src)] = string(tel_dst);
     log(__FUNCTION__, ": inserted");
 }
 
@@ -138,13 +462,19 @@ void jnp1::maptel_erase(unsigned long id, char const *tel_src) {
     check_number(tel_src);
 
     dictionary& dic = dictionaries()[id];
-    auto el = dic.find(tel_src);
+    if (dic.shared) {
+        log(__FUNCTION__, dic.shared->erase(tel_src) ? ": erased" : ": nothing to erase");
+        return;
+    }
+
+    auto el = dic.changes.find(tel_src);
 
-    if (el == dic.end()) {
+    if (el == dic.changes.end()) {
         log(__FUNCTION__, ": nothing to erase");
     }
     else {
-        dic.erase(tel_src);
+        dic.unseal();
+        dic.changes.erase(el);
         log(__FUNCTION__, ": erased");
     }
 }
@@ -156,8 +486,62 @@ void jnp1::maptel_transform(unsigned long id, char const *tel_src, char *tel_dst
     check_number(tel_src);
 
     string src = string(tel_src);
-    unordered_set<string> visited;
-    bool hasCycle = traverse(dictionaries()[id], src, src, tel_dst, len, visited);
-    if (hasCycle) log(__FUNCTION__, ": cycle detected");
+    dictionary& dic = dictionaries()[id];
+
+    if (dic.shared) {
+        bool hasCycle = dic.shared->transform(src, tel_dst, len);
+        if (hasCycle) log(__FUNCTION__, ": cycle detected");
+    }
+    else if (dic.sealed) {
+        auto found = dic.resolved.find(src);
+        const string &dst = (found == dic.resolved.end() || found->second == no_terminal)
+                            ? src : dic.terminals[found->second];
+        assert(dst.length() < len);
+        strcpy(tel_dst, dst.c_str());
+        if (found != dic.resolved.end() && found->second == no_terminal) log(__FUNCTION__, ": cycle detected");
+    }
+    else {
+        unordered_set<string> visited;
+        bool hasCycle = traverse(dic.changes, src, src, tel_dst, len, visited);
+        if (hasCycle) log(__FUNCTION__, ": cycle detected");
+    }
     log(__FUNCTION__, ": " + src + " -> " + + tel_dst);
 }
+
+void jnp1::maptel_seal(unsigned long id) {
+    log(__FUNCTION__, id);
+    assert(dictionaries().count(id) != 0);
+
+    dictionary& dic = dictionaries()[id];
+    if (dic.shared) {
+        log(__FUNCTION__, ": shared dictionaries are not sealed");
+        return;
+    }
+
+    seal(dic);
+    log(__FUNCTION__, ": " + to_string(dic.resolved.size()) + " numbers resolved");
+}
+
+unsigned long jnp1::maptel_create_shared(char const *name, size_t capacity) {
+    assert(name != NULL);
+    log(__FUNCTION__, string("(") + name + ", " + to_string(capacity) + ")");
+
+    dictionary dic;
+    dic.shared = make_unique<shared_table>(name, capacity);
+    dictionaries().emplace(dicts_size, move(dic));
+    log(__FUNCTION__, ": new shared map id = " + to_string(dicts_size));
+
+    return dicts_size++;
+}
+
+unsigned long jnp1::maptel_open_shared(char const *name) {
+    assert(name != NULL);
+    log(__FUNCTION__, string("(") + name + ")");
+
+    dictionary dic;
+    dic.shared = make_unique<shared_table>(name);
+    dictionaries().emplace(dicts_size, move(dic));
+    log(__FUNCTION__, ": new shared map id = " + to_string(dicts_size));
+
+    return dicts_size++;
+}
@@ -34,6 +34,23 @@ extern "C" {
         // Value len is the size of the memory that tel_dst points to.
         void maptel_transform(unsigned long id, char const *tel_src, char *tel_dst, size_t len);
 
+        // Resolves the changes of every number stored in the dictionary with the corresponding id,
+        // so that subsequent maptel_transform calls do not follow the changes one by one.
+        // Any later maptel_insert or maptel_erase on this dictionary drops the resolved changes.
+        void maptel_seal(unsigned long id);
+
+        // Creates a dictionary kept in the POSIX shared memory segment with the given name
+        // (e.g. "/maptel") and returns its id. Only this process may modify the dictionary.
+        // Value capacity is the maximal number of changes the dictionary holds, inserting
+        // a change of one more number terminates the program. So does an existing segment
+        // with the same name, which is never reused. The segment is removed when the dictionary is deleted.
+        unsigned long maptel_create_shared(char const *name, size_t capacity);
+
+        // Attaches read-only to the dictionary created by maptel_create_shared in another process
+        // and returns its id, which can be used with maptel_transform and maptel_delete.
+        // Terminates the program if the segment is not such a dictionary.
+        unsigned long maptel_open_shared(char const *name);
+
 #ifdef __cplusplus
     }
 };
@@ -0,0 +1,292 @@
+/* Benchmark of the maptel module (C driver).
+ *
+ * Build with logging disabled, otherwise every call prints to stderr:
+ *   g++ -std=c++17 -O2 -DNDEBUG -c maptel.cc
+ *   gcc -std=c11 -O2 -c maptel_bench.c
+ *   g++ maptel_bench.o maptel.o -o maptel_bench_c
+ *
+ * Usage: ./maptel_bench_c [scale]
+ * The scale (default 1) multiplies the size of every workload.
+ */
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include "maptel.h"
+
+/* TEL_NUM_MAX_LEN + 1, TEL_NUM_MAX_LEN is not a constant expression in C. */
+#define NUM_SIZE 23
+
+enum op_kind { OP_INSERT, OP_ERASE, OP_TRANSFORM };
+
+/* Latencies (in nanoseconds) of the single calls measured in one workload phase. */
+struct recorder {
+    const char *name;
+    long long *latencies;
+    size_t count;
+    size_t capacity;
+    struct timespec start;
+};
+
+static uint64_t rng_state = 2022;
+
+/* xorshift64* generator, deterministic across runs. */
+static uint64_t rng(void) {
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 2685821657736338717ULL;
+}
+
+static char buffer[NUM_SIZE];
+
+static long long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long) ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void recorder_init(struct recorder *rec, const char *name, size_t capacity) {
+    rec->name = name;
+    rec->latencies = malloc(capacity * sizeof(long long));
+    rec->count = 0;
+    rec->capacity = capacity;
+    clock_gettime(CLOCK_MONOTONIC, &rec->start);
+    if (rec->latencies == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+}
+
+/* Performs a single maptel call and records its latency. */
+static void recorder_measure(struct recorder *rec, enum op_kind kind, unsigned long id,
+                             char const *src, char const *dst) {
+    long long before = now_ns();
+    switch (kind) {
+        case OP_INSERT:
+            maptel_insert(id, src, dst);
+            break;
+        case OP_ERASE:
+            maptel_erase(id, src);
+            break;
+        case OP_TRANSFORM:
+            maptel_transform(id, src, buffer, sizeof(buffer));
+            break;
+    }
+    long long after = now_ns();
+    if (rec->count < rec->capacity) rec->latencies[rec->count++] = after - before;
+}
+
+/* Resident set size of the process in kB, or 0 if /proc/self/statm cannot be read. */
+static long current_rss_kb(void) {
+    FILE *statm = fopen("/proc/self/statm", "r");
+    long size = 0, resident = 0;
+
+    if (statm == NULL) return 0;
+    if (fscanf(statm, "%ld %ld", &size, &resident) != 2) resident = 0;
+    fclose(statm);
+    return resident * (sysconf(_SC_PAGESIZE) / 1024);
+}
+
+/* Resident set size at the start of the current workload. */
+static long workload_rss_kb;
+
+/* Starts a workload. The memory freed by the previous ones is returned to the system first,
+ * so that the growth of the resident set is the memory held by this workload. */
+static void workload_begin(void) {
+#ifdef __GLIBC__
+    malloc_trim(0);
+#endif
+    workload_rss_kb = current_rss_kb();
+}
+
+static int compare_ll(const void *a, const void *b) {
+    long long x = *(const long long *) a;
+    long long y = *(const long long *) b;
+    return (x > y) - (x < y);
+}
+
+static long long percentile(const struct recorder *rec, double p) {
+    if (rec->count == 0) return 0;
+    return rec->latencies[(size_t) (p / 100 * (double) (rec->count - 1))];
+}
+
+static void recorder_report(struct recorder *rec) {
+    struct timespec end;
+    double elapsed;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    elapsed = (double) (end.tv_sec - rec->start.tv_sec) + (double) (end.tv_nsec - rec->start.tv_nsec) / 1e9;
+    qsort(rec->latencies, rec->count, sizeof(long long), compare_ll);
+
+    printf("%-22s %10zu %12.0f %8lld %8lld %8lld %8lld %10lld %13ld\n",
+           rec->name, rec->count, (double) rec->count / elapsed,
+           percentile(rec, 50), percentile(rec, 90), percentile(rec, 99), percentile(rec, 99.9),
+           rec->count == 0 ? 0LL : rec->latencies[rec->count - 1], current_rss_kb() - workload_rss_kb);
+
+    free(rec->latencies);
+}
+
+/* Array of count random telephone numbers of the maximal length. */
+static char (*random_numbers(size_t count))[NUM_SIZE] {
+    char (*nums)[NUM_SIZE] = malloc(count * NUM_SIZE);
+    size_t i, j;
+
+    if (nums == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (i = 0; i < count; i++) {
+        for (j = 0; j < TEL_NUM_MAX_LEN; j++) nums[i][j] = (char) ('0' + rng() % 10);
+        nums[i][TEL_NUM_MAX_LEN] = '\0';
+    }
+    return nums;
+}
+
+/* Random inserts, erases and transforms over a fixed pool of numbers. */
+static void random_mix(size_t scale) {
+    const size_t pool_size = 10000 * scale;
+    const size_t ops = 200000 * scale;
+    char (*pool)[NUM_SIZE] = random_numbers(pool_size);
+    unsigned long id = maptel_create();
+    struct recorder rec;
+    size_t i;
+
+    recorder_init(&rec, "random_mix", ops);
+    for (i = 0; i < ops; i++) {
+        char const *src = pool[rng() % pool_size];
+        unsigned kind = (unsigned) (rng() % 10);
+        if (kind < 5)
+            recorder_measure(&rec, OP_INSERT, id, src, pool[rng() % pool_size]);
+        else if (kind < 7)
+            recorder_measure(&rec, OP_ERASE, id, src, NULL);
+        else
+            recorder_measure(&rec, OP_TRANSFORM, id, src, NULL);
+    }
+    recorder_report(&rec);
+
+    maptel_delete(id);
+    free(pool);
+}
+
+/* One chain n_0 -> n_1 -> ... -> n_len, transformed from random positions. */
+static void long_chain(size_t scale) {
+    const size_t len = 2000 * scale;
+    const size_t queries = 2000 * scale;
+    char (*chain)[NUM_SIZE] = random_numbers(len + 1);
+    unsigned long id = maptel_create();
+    struct recorder rec;
+    size_t i;
+
+    recorder_init(&rec, "long_chain/insert", len);
+    for (i = 0; i < len; i++)
+        recorder_measure(&rec, OP_INSERT, id, chain[i], chain[i + 1]);
+    recorder_report(&rec);
+
+    recorder_init(&rec, "long_chain/transform", queries);
+    for (i = 0; i < queries; i++)
+        recorder_measure(&rec, OP_TRANSFORM, id, chain[rng() % len], NULL);
+    recorder_report(&rec);
+
+    maptel_seal(id);
+    recorder_init(&rec, "long_chain/sealed", queries);
+    for (i = 0; i < queries; i++)
+        recorder_measure(&rec, OP_TRANSFORM, id, chain[rng() % len], NULL);
+    recorder_report(&rec);
+
+    maptel_delete(id);
+    free(chain);
+}
+
+/* Many disjoint cycles, every transform has to detect one of them. */
+static void cycles(size_t scale) {
+    const size_t cycle_len = 50;
+    const size_t cycle_count = 200 * scale;
+    const size_t queries = 50000 * scale;
+    const size_t total = cycle_len * cycle_count;
+    char (*nums)[NUM_SIZE] = random_numbers(total);
+    unsigned long id = maptel_create();
+    struct recorder rec;
+    size_t c, i;
+
+    for (c = 0; c < cycle_count; c++)
+        for (i = 0; i < cycle_len; i++)
+            maptel_insert(id, nums[c * cycle_len + i], nums[c * cycle_len + (i + 1) % cycle_len]);
+
+    recorder_init(&rec, "cycles/transform", queries);
+    for (i = 0; i < queries; i++)
+        recorder_measure(&rec, OP_TRANSFORM, id, nums[rng() % total], NULL);
+    recorder_report(&rec);
+
+    maptel_seal(id);
+    recorder_init(&rec, "cycles/sealed", queries);
+    for (i = 0; i < queries; i++)
+        recorder_measure(&rec, OP_TRANSFORM, id, nums[rng() % total], NULL);
+    recorder_report(&rec);
+
+    maptel_delete(id);
+    free(nums);
+}
+
+/* The same number of short chains split across dict_count dictionaries. */
+static void split_dictionaries(const char *name, size_t dict_count, size_t total_entries, size_t queries) {
+    const size_t chain_len = 4;
+    const size_t per_dict = total_entries / dict_count;
+    unsigned long *ids = malloc(dict_count * sizeof(unsigned long));
+    char (*nums)[NUM_SIZE] = random_numbers(per_dict * dict_count);
+    struct recorder rec;
+    size_t d, i;
+
+    if (ids == NULL) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    for (d = 0; d < dict_count; d++) {
+        ids[d] = maptel_create();
+        for (i = 0; i < per_dict; i++) {
+            /* Numbers form chains of chain_len changes each. */
+            if ((i + 1) % (chain_len + 1) != 0 && i + 1 < per_dict)
+                maptel_insert(ids[d], nums[d * per_dict + i], nums[d * per_dict + i + 1]);
+        }
+    }
+
+    recorder_init(&rec, name, queries);
+    for (i = 0; i < queries; i++) {
+        d = rng() % dict_count;
+        recorder_measure(&rec, OP_TRANSFORM, ids[d], nums[d * per_dict + rng() % per_dict], NULL);
+    }
+    recorder_report(&rec);
+
+    for (d = 0; d < dict_count; d++) maptel_delete(ids[d]);
+    free(ids);
+    free(nums);
+}
+
+int main(int argc, char *argv[]) {
+    size_t scale = argc > 1 ? strtoul(argv[1], NULL, 10) : 1;
+    if (scale == 0) scale = 1;
+
+    /* rss_delta is the growth of the resident set since the start of the workload. */
+    printf("%-22s %10s %12s %8s %8s %8s %8s %10s %13s\n", "workload", "ops", "ops/s",
+           "p50[ns]", "p90[ns]", "p99[ns]", "p999[ns]", "max[ns]", "rss_delta[kB]");
+
+    workload_begin();
+    random_mix(scale);
+    workload_begin();
+    long_chain(scale);
+    workload_begin();
+    cycles(scale);
+    workload_begin();
+    split_dictionaries("many_small/transform", 10000 * scale, 500000 * scale, 200000 * scale);
+    workload_begin();
+    split_dictionaries("one_huge/transform", 1, 500000 * scale, 200000 * scale);
+
+    return 0;
+}
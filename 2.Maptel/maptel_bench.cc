@@ -0,0 +1,240 @@
+// Benchmark of the maptel module (C++ driver).
+//
+// Build with logging disabled, otherwise every call prints to stderr:
+//   g++ -std=c++17 -O2 -DNDEBUG -c maptel.cc
+//   g++ -std=c++17 -O2 -DNDEBUG maptel_bench.cc maptel.o -o maptel_bench
+//
+// Usage: ./maptel_bench [scale]
+// The scale (default 1) multiplies the size of every workload.
+
+#include <unistd.h>
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include "maptel.h"
+
+using namespace std;
+using namespace jnp1;
+
+namespace {
+    using bench_clock = chrono::steady_clock;
+
+    // Resident set size of the process in kB, or 0 if /proc/self/statm cannot be read.
+    long current_rss_kb() {
+        FILE *statm = fopen("/proc/self/statm", "r");
+        if (statm == nullptr) return 0;
+        long size = 0, resident = 0;
+        if (fscanf(statm, "%ld %ld", &size, &resident) != 2) resident = 0;
+        fclose(statm);
+        return resident * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+
+    // Resident set size at the start of the current workload.
+    long workload_rss_kb = 0;
+
+    // Starts a workload. The memory freed by the previous ones is returned to the system first,
+    // so that the growth of the resident set is the memory held by this workload.
+    void workload_begin() {
+#ifdef __GLIBC__
+        malloc_trim(0);
+#endif
+        workload_rss_kb = current_rss_kb();
+    }
+
+    // Latencies (in nanoseconds) of the single calls measured in one workload phase.
+    class recorder {
+        public:
+            recorder(const char *name) : name(name), start(bench_clock::now()) { }
+
+            template<class F>
+            void measure(F &&f) {
+                auto before = bench_clock::now();
+                f();
+                auto after = bench_clock::now();
+                latencies.push_back(chrono::duration_cast<chrono::nanoseconds>(after - before).count());
+            }
+
+            void report() {
+                double elapsed = chrono::duration<double>(bench_clock::now() - start).count();
+                sort(latencies.begin(), latencies.end());
+
+                printf("%-22s %10zu %12.0f %8lld %8lld %8lld %8lld %10lld %13ld\n",
+                       name, latencies.size(), latencies.size() / elapsed,
+                       percentile(50), percentile(90), percentile(99), percentile(99.9),
+                       latencies.empty() ? 0LL : latencies.back(), current_rss_kb() - workload_rss_kb);
+            }
+
+        private:
+            const char *name;
+            bench_clock::time_point start;
+            vector<long long> latencies;
+
+            long long percentile(double p) const {
+                if (latencies.empty()) return 0;
+                auto idx = static_cast<size_t>(p / 100 * (latencies.size() - 1));
+                return latencies[idx];
+            }
+    };
+
+    mt19937_64 rng(2022);
+
+    // Random telephone number of the maximal length.
+    string random_number() {
+        string num(TEL_NUM_MAX_LEN, '0');
+        for (auto &c : num) c = static_cast<char>('0' + rng() % 10);
+        return num;
+    }
+
+    vector<string> random_numbers(size_t count) {
+        vector<string> res(count);
+        for (auto &num : res) num = random_number();
+        return res;
+    }
+
+    char buffer[TEL_NUM_MAX_LEN + 1];
+
+    // Random inserts, erases and transforms over a fixed pool of numbers.
+    void random_mix(size_t scale) {
+        const size_t pool_size = 10000 * scale;
+        const size_t ops = 200000 * scale;
+        auto pool = random_numbers(pool_size);
+        unsigned long id = maptel_create();
+
+        recorder rec("random_mix");
+        for (size_t i = 0; i < ops; i++) {
+            const string &src = pool[rng() % pool_size];
+            unsigned kind = rng() % 10;
+            if (kind < 5) {
+                const string &dst = pool[rng() % pool_size];
+                rec.measure([&] { maptel_insert(id, src.c_str(), dst.c_str()); });
+            }
+            else if (kind < 7) {
+                rec.measure([&] { maptel_erase(id, src.c_str()); });
+            }
+            else {
+                rec.measure([&] { maptel_transform(id, src.c_str(), buffer, sizeof(buffer)); });
+            }
+        }
+        rec.report();
+        maptel_delete(id);
+    }
+
+    // One chain n_0 -> n_1 -> ... -> n_len, transformed from random positions.
+    void long_chain(size_t scale) {
+        const size_t len = 2000 * scale;
+        const size_t queries = 2000 * scale;
+        auto chain = random_numbers(len + 1);
+        unsigned long id = maptel_create();
+
+        recorder build("long_chain/insert");
+        for (size_t i = 0; i < len; i++)
+            build.measure([&] { maptel_insert(id, chain[i].c_str(), chain[i + 1].c_str()); });
+        build.report();
+
+        recorder query("long_chain/transform");
+        for (size_t i = 0; i < queries; i++) {
+            const string &src = chain[rng() % len];
+            query.measure([&] { maptel_transform(id, src.c_str(), buffer, sizeof(buffer)); });
+        }
+        query.report();
+
+        maptel_seal(id);
+        recorder sealed("long_chain/sealed");
+        for (size_t i = 0; i < queries; i++) {
+            const string &src = chain[rng() % len];
+            sealed.measure([&] { maptel_transform(id, src.c_str(), buffer, sizeof(buffer)); });
+        }
+        sealed.report();
+        maptel_delete(id);
+    }
+
+    // Many disjoint cycles, every transform has to detect one of them.
+    void cycles(size_t scale) {
+        const size_t cycle_len = 50;
+        const size_t cycle_count = 200 * scale;
+        const size_t queries = 50000 * scale;
+        auto nums = random_numbers(cycle_len * cycle_count);
+        unsigned long id = maptel_create();
+
+        for (size_t c = 0; c < cycle_count; c++) {
+            for (size_t i = 0; i < cycle_len; i++) {
+                size_t from = c * cycle_len + i;
+                size_t to = c * cycle_len + (i + 1) % cycle_len;
+                maptel_insert(id, nums[from].c_str(), nums[to].c_str());
+            }
+        }
+
+        recorder rec("cycles/transform");
+        for (size_t i = 0; i < queries; i++) {
+            const string &src = nums[rng() % nums.size()];
+            rec.measure([&] { maptel_transform(id, src.c_str(), buffer, sizeof(buffer)); });
+        }
+        rec.report();
+
+        maptel_seal(id);
+        recorder sealed("cycles/sealed");
+        for (size_t i = 0; i < queries; i++) {
+            const string &src = nums[rng() % nums.size()];
+            sealed.measure([&] { maptel_transform(id, src.c_str(), buffer, sizeof(buffer)); });
+        }
+        sealed.report();
+        maptel_delete(id);
+    }
+
+    // The same number of short chains split across dict_count dictionaries.
+    void split_dictionaries(const char *name, size_t dict_count, size_t total_entries, size_t queries) {
+        const size_t chain_len = 4;
+        const size_t per_dict = total_entries / dict_count;
+        vector<unsigned long> ids(dict_count);
+        vector<vector<string>> nums(dict_count);
+
+        for (size_t d = 0; d < dict_count; d++) {
+            ids[d] = maptel_create();
+            nums[d] = random_numbers(per_dict);
+            for (size_t i = 0; i < per_dict; i++) {
+                // Numbers form chains of chain_len changes each.
+                if ((i + 1) % (chain_len + 1) != 0 && i + 1 < per_dict)
+                    maptel_insert(ids[d], nums[d][i].c_str(), nums[d][i + 1].c_str());
+            }
+        }
+
+        recorder rec(name);
+        for (size_t i = 0; i < queries; i++) {
+            size_t d = rng() % dict_count;
+            const string &src = nums[d][rng() % per_dict];
+            rec.measure([&] { maptel_transform(ids[d], src.c_str(), buffer, sizeof(buffer)); });
+        }
+        rec.report();
+
+        for (auto id : ids) maptel_delete(id);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    size_t scale = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1;
+    if (scale == 0) scale = 1;
+
+    // rss_delta is the growth of the resident set since the start of the workload.
+    printf("%-22s %10s %12s %8s %8s %8s %8s %10s %13s\n", "workload", "ops", "ops/s",
+           "p50[ns]", "p90[ns]", "p99[ns]", "p999[ns]", "max[ns]", "rss_delta[kB]");
+
+    workload_begin();
+    random_mix(scale);
+    workload_begin();
+    long_chain(scale);
+    workload_begin();
+    cycles(scale);
+    workload_begin();
+    split_dictionaries("many_small/transform", 10000 * scale, 500000 * scale, 200000 * scale);
+    workload_begin();
+    split_dictionaries("one_huge/transform", 1, 500000 * scale, 200000 * scale);
+
+    return 0;
+}
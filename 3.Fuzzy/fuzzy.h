@@ -5,123 +5,218 @@
 #include <tuple>
 #include <cmath>
 #include <set>
+#include <type_traits>
+#include <concepts>
+#include <stdexcept>
+#include <optional>
+#include <vector>
+#include <iterator>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <limits>
+#include <ext/pb_ds/assoc_container.hpp>
+#include <ext/pb_ds/tree_policy.hpp>
 
 using namespace std;
 using real_t = double;
 
 namespace utils {
-    constexpr real_t min_of_3(real_t a, real_t b, real_t c) {
+    template<floating_point T>
+    constexpr T min_of_3(T a, T b, T c) {
         return min(min(a, b), c);
     }
 
-    constexpr real_t max_of_3(real_t a, real_t b, real_t c) {
+    template<floating_point T>
+    constexpr T max_of_3(T a, T b, T c) {
         return max(max(a, b), c);
     }
 
-    constexpr real_t mid_of_3(real_t a, real_t b, real_t c) {
+    template<floating_point T>
+    constexpr T mid_of_3(T a, T b, T c) {
         return a <= b ? (b <= c ? b : (a <= c ? c : a)) : (a <= c ? a : (b <= c ? c : b));
     }
 
-    constexpr real_t calc_z(real_t l, real_t m, real_t u) {
+    template<floating_point T>
+    constexpr T calc_z(T l, T m, T u) {
         return (u - l) + sqrt(1 + (u - m) * (u - m)) + sqrt(1 + (m - l) * (m - l));
     }
 
-    constexpr real_t calc_x(real_t l, real_t m, real_t u) {
+    template<floating_point T>
+    constexpr T calc_x(T l, T m, T u) {
         return ((u - l) * m + sqrt(1 + (u - m) * (u - m)) * l + sqrt(1 + (m - l) * (m - l)) * u) / calc_z(l, m, u);
     }
 
-    constexpr real_t calc_y(real_t l, real_t m, real_t u) {
+    template<floating_point T>
+    constexpr T calc_y(T l, T m, T u) {
         return (u - l) / calc_z(l, m, u);
     }
 }
 
-class TriFuzzyNum {
+// Triangular fuzzy number with values of the floating point type T.
+template<floating_point T>
+class BasicTriFuzzyNum {
     public:
-        constexpr TriFuzzyNum(real_t arg1, real_t arg2, real_t arg3);
-        constexpr TriFuzzyNum(const TriFuzzyNum &other);
-        constexpr TriFuzzyNum(TriFuzzyNum &&other);
-        constexpr TriFuzzyNum& operator=(const TriFuzzyNum &other);
-        constexpr TriFuzzyNum& operator=(TriFuzzyNum &&other);
-        constexpr TriFuzzyNum& operator+=(const TriFuzzyNum &other);
-        constexpr TriFuzzyNum operator+(const TriFuzzyNum &other) const;
-        constexpr TriFuzzyNum& operator-=(const TriFuzzyNum &other);
-        constexpr TriFuzzyNum operator-(const TriFuzzyNum &other) const;
-        constexpr TriFuzzyNum& operator*=(const TriFuzzyNum &other);
-        constexpr TriFuzzyNum operator*(const TriFuzzyNum &other) const;
-        constexpr bool operator==(const TriFuzzyNum &other) const;
-        constexpr bool operator!=(const TriFuzzyNum &other) const;
-        constexpr partial_ordering operator<=>(const TriFuzzyNum &other) const;
-        constexpr const real_t& lower_value() const;
-        constexpr const real_t& modal_value() const;
-        constexpr const real_t& upper_value() const;
+        using value_type = T;
+
+        constexpr BasicTriFuzzyNum(T arg1, T arg2, T arg3);
+        constexpr BasicTriFuzzyNum(const BasicTriFuzzyNum &other);
+        constexpr BasicTriFuzzyNum(BasicTriFuzzyNum &&other);
+        constexpr BasicTriFuzzyNum& operator=(const BasicTriFuzzyNum &other);
+        constexpr BasicTriFuzzyNum& operator=(BasicTriFuzzyNum &&other);
+        constexpr BasicTriFuzzyNum& operator+=(const BasicTriFuzzyNum &other);
+        constexpr BasicTriFuzzyNum operator+(const BasicTriFuzzyNum &other) const;
+        constexpr BasicTriFuzzyNum& operator-=(const BasicTriFuzzyNum &other);
+        constexpr BasicTriFuzzyNum operator-(const BasicTriFuzzyNum &other) const;
+        constexpr BasicTriFuzzyNum& operator*=(const BasicTriFuzzyNum &other);
+        constexpr BasicTriFuzzyNum operator*(const BasicTriFuzzyNum &other) const;
+        constexpr bool operator==(const BasicTriFuzzyNum &other) const;
+        constexpr bool operator!=(const BasicTriFuzzyNum &other) const;
+        constexpr partial_ordering operator<=>(const BasicTriFuzzyNum &other) const;
+        constexpr const T& lower_value() const;
+        constexpr const T& modal_value() const;
+        constexpr const T& upper_value() const;
     private:
-        real_t l;
-        real_t m;
-        real_t u;
-        tuple<real_t, real_t, real_t> rank;
-        friend ostream& operator<<(ostream&, const TriFuzzyNum&);
+        using rank_t = tuple<T, T, T>;
+
+        T l;
+        T m;
+        T u;
+        // The rank is (rank_x, rank_y, m). It is computed on the first comparison,
+        // so the results of arithmetic that are never compared do not pay for it.
+        // The first thread to claim rank_state writes the cache and publishes it, so that const
+        // objects can still be compared by many threads at once. The others compute the rank
+        // themselves until it is published.
+        enum rank_state_t : unsigned char { rank_missing, rank_writing, rank_ready };
+        mutable T rank_x;
+        mutable T rank_y;
+        mutable atomic<unsigned char> rank_state;
+
+        constexpr void copy_rank(const BasicTriFuzzyNum &other);
+
+        constexpr rank_t rank() const;
+        template<floating_point U>
+        friend ostream& operator<<(ostream&, const BasicTriFuzzyNum<U>&);
 };
 
-constexpr TriFuzzyNum::TriFuzzyNum(real_t arg1, real_t arg2, real_t arg3) : l(utils::min_of_3(arg1, arg2, arg3)),
-                                                                            m(utils::mid_of_3(arg1, arg2, arg3)),
-                                                                            u(utils::max_of_3(arg1, arg2, arg3)) {
-    real_t x_this = utils::calc_x(l, m, u);
-    real_t y_this = utils::calc_y(l, m, u);
+using TriFuzzyNum = BasicTriFuzzyNum<real_t>;
+
+template<floating_point T>
+constexpr BasicTriFuzzyNum<T>::BasicTriFuzzyNum(T arg1, T arg2, T arg3) : l(utils::min_of_3(arg1, arg2, arg3)),
+                                                                          m(utils::mid_of_3(arg1, arg2, arg3)),
+                                                                          u(utils::max_of_3(arg1, arg2, arg3)),
+                                                                          rank_x(0), rank_y(0), rank_state(rank_missing) { }
+template<floating_point T>
+constexpr BasicTriFuzzyNum<T>::BasicTriFuzzyNum(const BasicTriFuzzyNum &other) : l(other.l), m(other.m), u(other.u),
+                                                                                 rank_x(0), rank_y(0),
+                                                                                 rank_state(rank_missing) {
+    copy_rank(other);
+}
+template<floating_point T>
+constexpr BasicTriFuzzyNum<T>::BasicTriFuzzyNum(BasicTriFuzzyNum &&other) : BasicTriFuzzyNum(other) { };
+
+// Copies the cached rank of other, if it has one. The cache is not used in constant expressions,
+// the atomics cannot be accessed there.
+template<floating_point T>
+constexpr void BasicTriFuzzyNum<T>::copy_rank(const BasicTriFuzzyNum &other) {
+    if (!is_constant_evaluated()) {
+        bool ready = other.rank_state.load(memory_order_acquire) == rank_ready;
+        if (ready) {
+            rank_x = other.rank_x;
+            rank_y = other.rank_y;
+        }
+        rank_state.store(ready ? rank_ready : rank_missing, memory_order_relaxed);
+    }
+}
+
+template<floating_point T>
+constexpr typename BasicTriFuzzyNum<T>::rank_t BasicTriFuzzyNum<T>::rank() const {
+    if (is_constant_evaluated()) {
+        T x_this = utils::calc_x(l, m, u);
+        T y_this = utils::calc_y(l, m, u);
+        return make_tuple(x_this - y_this / 2, 1 - y_this, m);
+    }
+
+    unsigned char state = rank_state.load(memory_order_acquire);
+    if (state == rank_ready)
+        return make_tuple(rank_x, rank_y, m);
 
-    rank = make_tuple(x_this - y_this / 2, 1 - y_this, m);
+    T x_this = utils::calc_x(l, m, u);
+    T y_this = utils::calc_y(l, m, u);
+    if (state == rank_missing && rank_state.compare_exchange_strong(state, rank_writing, memory_order_relaxed)) {
+        rank_x = x_this - y_this / 2;
+        rank_y = 1 - y_this;
+        rank_state.store(rank_ready, memory_order_release);
+    }
+    return make_tuple(x_this - y_this / 2, 1 - y_this, m);
 }
-constexpr TriFuzzyNum::TriFuzzyNum(const TriFuzzyNum &other) = default;
-constexpr TriFuzzyNum::TriFuzzyNum(TriFuzzyNum &&other) : l(other.l), m(other.m), u(other.u), rank(move(other.rank)) { };
 
-constexpr const real_t& TriFuzzyNum::lower_value() const {return l; };
-constexpr const real_t& TriFuzzyNum::modal_value() const { return m; };
-constexpr const real_t& TriFuzzyNum::upper_value() const { return u; };
+template<floating_point T>
+constexpr const T& BasicTriFuzzyNum<T>::lower_value() const {return l; };
+template<floating_point T>
+constexpr const T& BasicTriFuzzyNum<T>::modal_value() const { return m; };
+template<floating_point T>
+constexpr const T& BasicTriFuzzyNum<T>::upper_value() const { return u; };
 
-constexpr TriFuzzyNum& TriFuzzyNum::operator=(const TriFuzzyNum &other) = default;
-constexpr TriFuzzyNum& TriFuzzyNum::operator=(TriFuzzyNum &&other) {
+template<floating_point T>
+constexpr BasicTriFuzzyNum<T>& BasicTriFuzzyNum<T>::operator=(const BasicTriFuzzyNum &other) {
     l = other.l;
     m = other.m;
     u = other.u;
-    rank = move(other.rank);
+    copy_rank(other);
     return *this;
 }
+template<floating_point T>
+constexpr BasicTriFuzzyNum<T>& BasicTriFuzzyNum<T>::operator=(BasicTriFuzzyNum &&other) {
+    return *this = other;
+}
 
-constexpr TriFuzzyNum& TriFuzzyNum::operator+=(const TriFuzzyNum &other) {
-    *this = TriFuzzyNum{l + other.l, m + other.m, u + other.u};
+template<floating_point T>
+constexpr BasicTriFuzzyNum<T>& BasicTriFuzzyNum<T>::operator+=(const BasicTriFuzzyNum &other) {
+    *this = BasicTriFuzzyNum{l + other.l, m + other.m, u + other.u};
     return *this;
 }
-constexpr TriFuzzyNum TriFuzzyNum::operator+(const TriFuzzyNum &other) const {
-    return TriFuzzyNum(*this) += other;
+template<floating_point T>
+constexpr BasicTriFuzzyNum<T> BasicTriFuzzyNum<T>::operator+(const BasicTriFuzzyNum &other) const {
+    return BasicTriFuzzyNum(*this) += other;
 }
 
-constexpr TriFuzzyNum& TriFuzzyNum::operator-=(const TriFuzzyNum &other) {
-    *this = TriFuzzyNum{l - other.u, m - other.m, u - other.l};
+template<floating_point T>
+constexpr BasicTriFuzzyNum<T>& BasicTriFuzzyNum<T>::operator-=(const BasicTriFuzzyNum &other) {
+    *this = BasicTriFuzzyNum{l - other.u, m - other.m, u - other.l};
     return *this;
 }
-constexpr TriFuzzyNum TriFuzzyNum::operator-(const TriFuzzyNum &other) const {
-    return TriFuzzyNum(*this) -= other;
+template<floating_point T>
+constexpr BasicTriFuzzyNum<T> BasicTriFuzzyNum<T>::operator-(const BasicTriFuzzyNum &other) const {
+    return BasicTriFuzzyNum(*this) -= other;
 }
 
-constexpr TriFuzzyNum& TriFuzzyNum::operator*=(const TriFuzzyNum &other) {
-    *this = TriFuzzyNum{l * other.l, m * other.m, u * other.u};
+template<floating_point T>
+constexpr BasicTriFuzzyNum<T>& BasicTriFuzzyNum<T>::operator*=(const BasicTriFuzzyNum &other) {
+    *this = BasicTriFuzzyNum{l * other.l, m * other.m, u * other.u};
     return *this;
 }
-constexpr TriFuzzyNum TriFuzzyNum::operator*(const TriFuzzyNum &other) const {
-    return TriFuzzyNum(*this) *= other;
+template<floating_point T>
+constexpr BasicTriFuzzyNum<T> BasicTriFuzzyNum<T>::operator*(const BasicTriFuzzyNum &other) const {
+    return BasicTriFuzzyNum(*this) *= other;
 }
 
-constexpr bool TriFuzzyNum::operator==(const TriFuzzyNum &other) const {
+template<floating_point T>
+constexpr bool BasicTriFuzzyNum<T>::operator==(const BasicTriFuzzyNum &other) const {
     return l == other.l && m == other.m && u == other.u;
 }
-constexpr bool TriFuzzyNum::operator!=(const TriFuzzyNum &other) const {
+template<floating_point T>
+constexpr bool BasicTriFuzzyNum<T>::operator!=(const BasicTriFuzzyNum &other) const {
     return !(*this == other);
 }
 
-constexpr partial_ordering TriFuzzyNum::operator<=>(const TriFuzzyNum &other) const {
-    return rank <=> other.rank;
+template<floating_point T>
+constexpr partial_ordering BasicTriFuzzyNum<T>::operator<=>(const BasicTriFuzzyNum &other) const {
+    return rank() <=> other.rank();
 }
 
-ostream& operator<<(ostream &os, const TriFuzzyNum &num) {
+template<floating_point T>
+ostream& operator<<(ostream &os, const BasicTriFuzzyNum<T> &num) {
     os << "("
        << num.l
        << ", " << num.m
@@ -130,67 +225,402 @@ ostream& operator<<(ostream &os, const TriFuzzyNum &num) {
     return os;
 }
 
-consteval TriFuzzyNum crisp_number(real_t v) {
+// The value type is not deduced, so crisp_number(0) is a TriFuzzyNum and crisp_number<float>(0)
+// its float counterpart.
+template<floating_point T = real_t>
+consteval BasicTriFuzzyNum<T> crisp_number(type_identity_t<T> v) {
     return {v, v, v};
 }
 
+template<floating_point T>
+constinit const BasicTriFuzzyNum<T> basic_crisp_zero = crisp_number<T>(0);
+
 constinit const TriFuzzyNum crisp_zero = crisp_number(0);
 
 /* ----- SET ----- */
 
-class TriFuzzyNumSet {
+namespace utils {
+    // Running sum of values that can also be taken out again. The finite values are summed with
+    // Neumaier's compensation, so that removing a large value does not wipe out the small ones,
+    // and the infinities and NaNs are only counted, so that removing them leaves no NaN behind.
+    // overflowed is set once the finite values sum up beyond the range of T, the sum is then
+    // unusable until it is recomputed.
+    template<floating_point T>
+    class compensated_sum {
+        public:
+            void add(T x) { update(x, true); }
+            void subtract(T x) { update(x, false); }
+
+            bool overflowed() const { return overflow; }
+
+            // The same as the plain sum of the values, up to the rounding of the finite ones.
+            T value() const {
+                if (nans > 0 || (pos_infs > 0 && neg_infs > 0)) return numeric_limits<T>::quiet_NaN();
+                if (pos_infs > 0) return numeric_limits<T>::infinity();
+                if (neg_infs > 0) return -numeric_limits<T>::infinity();
+                return sum + compensation;
+            }
+
+        private:
+            T sum = 0;
+            T compensation = 0;
+            size_t pos_infs = 0;
+            size_t neg_infs = 0;
+            size_t nans = 0;
+            bool overflow = false;
+
+            void update(T x, bool adding) {
+                if (isnan(x)) {
+                    adding ? nans++ : nans--;
+                }
+                else if (isinf(x)) {
+                    size_t &count = x > 0 ? pos_infs : neg_infs;
+                    adding ? count++ : count--;
+                }
+                else {
+                    T y = adding ? x : -x;
+                    T t = sum + y;
+                    if (isinf(t)) overflow = true;
+                    else compensation += abs(sum) >= abs(y) ? (sum - t) + y : (y - t) + sum;
+                    sum = t;
+                }
+            }
+    };
+
+    // Orders numbers by rank.
+    struct rank_less {
+        template<floating_point T>
+        bool operator()(const BasicTriFuzzyNum<T> &a, const BasicTriFuzzyNum<T> &b) const { return a < b; }
+    };
+
+    // Storage of TriFuzzyNumSet in a red-black tree where every node also stores the size
+    // of its subtree. One heap node per number, k-th number found in O(log n).
+    template<floating_point T>
+    class fuzzy_tree_storage {
+        private:
+            using num_t = BasicTriFuzzyNum<T>;
+            // Numbers of equal rank are kept in the order of insertion.
+            using entry_t = pair<num_t, size_t>;
+
+            struct entry_less {
+                bool operator()(const entry_t &a, const entry_t &b) const {
+                    return a.first < b.first || (!(b.first < a.first) && a.second < b.second);
+                }
+            };
+
+            using tree_t = __gnu_pbds::tree<entry_t, __gnu_pbds::null_type, entry_less, __gnu_pbds::rb_tree_tag,
+                                            __gnu_pbds::tree_order_statistics_node_update>;
+
+            tree_t s;
+            size_t next_seq = 0;
+
+        public:
+            class const_iterator {
+                public:
+                    using iterator_category = bidirectional_iterator_tag;
+                    using difference_type = ptrdiff_t;
+                    using value_type = num_t;
+                    using pointer = const num_t*;
+                    using reference = const num_t&;
+
+                    const_iterator() = default;
+                    const_iterator(typename tree_t::const_iterator it) : it(it) { }
+
+                    reference operator*() const { return it->first; }
+                    pointer operator->() const { return &it->first; }
+
+                    const_iterator& operator++() { ++it; return *this; }
+                    const_iterator operator++(int) { const_iterator res(*this); ++it; return res; }
+                    const_iterator& operator--() { --it; return *this; }
+                    const_iterator operator--(int) { const_iterator res(*this); --it; return res; }
+
+                    bool operator==(const const_iterator &other) const { return it == other.it; }
+                    bool operator!=(const const_iterator &other) const { return it != other.it; }
+
+                private:
+                    typename tree_t::const_iterator it;
+            };
+
+            void insert(num_t &&num) { s.insert({move(num), next_seq++}); }
+
+            // Removes one number of the same rank as num (the first inserted one) and returns it.
+            optional<num_t> remove(const num_t &num) {
+                auto iter = s.lower_bound({num, 0});
+                if (iter == s.end() || num < iter->first || iter->first < num) return nullopt;
+
+                optional<num_t> res(iter->first);
+                s.erase(iter);
+                return res;
+            }
+
+            size_t size() const { return s.size(); }
+            void clear() { s.clear(); next_seq = 0; }
+            const num_t& kth(size_t k) const { return s.find_by_order(k)->first; }
+            const_iterator begin() const { return s.begin(); }
+            const_iterator end() const { return s.end(); }
+
+            void swap(fuzzy_tree_storage &other) {
+                s.swap(other.s);
+                std::swap(next_seq, other.next_seq);
+            }
+    };
+
+    // Storage of TriFuzzyNumSet in a sorted vector. Inserted numbers are buffered and merged
+    // in one batch before the next read, so building the set costs one sort, iteration is
+    // sequential and the k-th number is found in O(1). Removal shifts the tail of the vector.
+    // The first read of a const set after inserts merges the buffer under a mutex, so concurrent
+    // reads are as safe as on the tree, and the later ones only check an atomic flag.
+    template<floating_point T>
+    class fuzzy_flat_storage {
+        private:
+            using num_t = BasicTriFuzzyNum<T>;
+
+            // Numbers of equal rank are kept in the order of insertion (stable sort and merge).
+            mutable vector<num_t> sorted;
+            mutable vector<num_t> pending;
+            // Set while pending is not empty, cleared with release only after the merge.
+            mutable atomic<bool> dirty = false;
+            mutable mutex merge_mutex;
+            // Kept apart from the vectors, which a concurrent read may be merging.
+            size_t count = 0;
+
+            void flush() const {
+                if (!dirty.load(memory_order_acquire)) return;
+
+                lock_guard lock(merge_mutex);
+                if (!dirty.load(memory_order_relaxed)) return;
+
+                stable_sort(pending.begin(), pending.end(), rank_less());
+                auto old_size = static_cast<ptrdiff_t>(sorted.size());
+                sorted.insert(sorted.end(), make_move_iterator(pending.begin()), make_move_iterator(pending.end()));
+                inplace_merge(sorted.begin(), sorted.begin() + old_size, sorted.end(), rank_less());
+                pending.clear();
+                dirty.store(false, memory_order_release);
+            }
+
+        public:
+            using const_iterator = typename vector<num_t>::const_iterator;
+
+            fuzzy_flat_storage() = default;
+
+            fuzzy_flat_storage(const fuzzy_flat_storage &other) {
+                other.flush();
+                sorted = other.sorted;
+                count = other.count;
+            }
+
+            fuzzy_flat_storage& operator=(const fuzzy_flat_storage &other) {
+                fuzzy_flat_storage copy(other);
+                swap(copy);
+                return *this;
+            }
+
+            void insert(num_t &&num) {
+                pending.push_back(move(num));
+                count++;
+                dirty.store(true, memory_order_relaxed);
+            }
+
+            // Removes one number of the same rank as num (the first inserted one) and returns it.
+            optional<num_t> remove(const num_t &num) {
+                flush();
+                auto iter = lower_bound(sorted.begin(), sorted.end(), num, rank_less());
+                if (iter == sorted.end() || num < *iter || *iter < num) return nullopt;
+
+                optional<num_t> res(move(*iter));
+                sorted.erase(iter);
+                count--;
+                return res;
+            }
+
+            size_t size() const { return count; }
+
+            void clear() {
+                sorted.clear();
+                pending.clear();
+                count = 0;
+                dirty.store(false, memory_order_relaxed);
+            }
+
+            const num_t& kth(size_t k) const { flush(); return sorted[k]; }
+            const_iterator begin() const { flush(); return sorted.cbegin(); }
+            const_iterator end() const { flush(); return sorted.cend(); }
+
+            void swap(fuzzy_flat_storage &other) {
+                sorted.swap(other.sorted);
+                pending.swap(other.pending);
+                std::swap(count, other.count);
+                bool was_dirty = dirty.load(memory_order_relaxed);
+                dirty.store(other.dirty.load(memory_order_relaxed), memory_order_relaxed);
+                other.dirty.store(was_dirty, memory_order_relaxed);
+            }
+    };
+}
+
+// Storage is utils::fuzzy_tree_storage<T> or utils::fuzzy_flat_storage<T>.
+template<floating_point T, class Storage = utils::fuzzy_tree_storage<T>>
+class BasicTriFuzzyNumSet {
     public:
-        TriFuzzyNumSet();
-        TriFuzzyNumSet(const TriFuzzyNumSet &other);
-        TriFuzzyNumSet(TriFuzzyNumSet &&other);
-        TriFuzzyNumSet(initializer_list<TriFuzzyNum> args);
-        TriFuzzyNumSet& operator=(const TriFuzzyNumSet &other);
-        TriFuzzyNumSet& operator=(TriFuzzyNumSet &&other);
-        void insert(const TriFuzzyNum &num);
-        void insert(TriFuzzyNum &&num);
-        void remove(const TriFuzzyNum &num);
-        TriFuzzyNum arithmetic_mean() const;
+        using value_type = BasicTriFuzzyNum<T>;
+        using const_iterator = typename Storage::const_iterator;
+
+        BasicTriFuzzyNumSet();
+        BasicTriFuzzyNumSet(const BasicTriFuzzyNumSet &other);
+        BasicTriFuzzyNumSet(BasicTriFuzzyNumSet &&other);
+        BasicTriFuzzyNumSet(initializer_list<value_type> args);
+        BasicTriFuzzyNumSet& operator=(const BasicTriFuzzyNumSet &other);
+        BasicTriFuzzyNumSet& operator=(BasicTriFuzzyNumSet &&other);
+        void insert(const value_type &num);
+        void insert(value_type &&num);
+        void remove(const value_type &num);
+        size_t size() const;
+        const_iterator begin() const;
+        const_iterator end() const;
+        value_type arithmetic_mean() const;
+        value_type kth_smallest(size_t k) const;
+        value_type median() const;
+        value_type percentile(T p) const;
     private:
-        multiset<TriFuzzyNum> s;
+        Storage s;
+        // Running sums of the values, so that the mean does not walk the whole set.
+        utils::compensated_sum<T> sum_l;
+        utils::compensated_sum<T> sum_m;
+        utils::compensated_sum<T> sum_u;
+
+        void clear();
+        bool sums_overflowed() const;
+        void recompute_sums();
 };
 
-TriFuzzyNumSet::TriFuzzyNumSet() = default;
-TriFuzzyNumSet::TriFuzzyNumSet(const TriFuzzyNumSet &other) = default;
-TriFuzzyNumSet::TriFuzzyNumSet(TriFuzzyNumSet &&other) : s(move(other.s)) { }
-TriFuzzyNumSet::TriFuzzyNumSet(initializer_list<TriFuzzyNum> args) : s(args) { };
+using TriFuzzyNumSet = BasicTriFuzzyNumSet<real_t>;
+
+// The same set in a sorted vector, faster to build in batches, iterate over and index, slower to remove from.
+template<floating_point T>
+using BasicTriFuzzyNumFlatSet = BasicTriFuzzyNumSet<T, utils::fuzzy_flat_storage<T>>;
+using TriFuzzyNumFlatSet = BasicTriFuzzyNumFlatSet<real_t>;
+
+template<floating_point T, class Storage>
+BasicTriFuzzyNumSet<T, Storage>::BasicTriFuzzyNumSet() = default;
+template<floating_point T, class Storage>
+BasicTriFuzzyNumSet<T, Storage>::BasicTriFuzzyNumSet(const BasicTriFuzzyNumSet &other) = default;
+template<floating_point T, class Storage>
+BasicTriFuzzyNumSet<T, Storage>::BasicTriFuzzyNumSet(BasicTriFuzzyNumSet &&other) : BasicTriFuzzyNumSet() {
+    *this = move(other);
+}
+template<floating_point T, class Storage>
+BasicTriFuzzyNumSet<T, Storage>::BasicTriFuzzyNumSet(initializer_list<value_type> args) {
+    for (const auto &num : args) insert(num);
+};
 
-TriFuzzyNumSet& TriFuzzyNumSet::operator=(const TriFuzzyNumSet &other) = default;
-TriFuzzyNumSet& TriFuzzyNumSet::operator=(TriFuzzyNumSet &&other) {
-    s = move(other.s);
+template<floating_point T, class Storage>
+BasicTriFuzzyNumSet<T, Storage>& BasicTriFuzzyNumSet<T, Storage>::operator=(const BasicTriFuzzyNumSet &other) = default;
+template<floating_point T, class Storage>
+BasicTriFuzzyNumSet<T, Storage>& BasicTriFuzzyNumSet<T, Storage>::operator=(BasicTriFuzzyNumSet &&other) {
+    if (this != &other) {
+        clear();
+        s.swap(other.s);
+        swap(sum_l, other.sum_l);
+        swap(sum_m, other.sum_m);
+        swap(sum_u, other.sum_u);
+    }
     return *this;
 }
 
-void TriFuzzyNumSet::insert(const TriFuzzyNum &num) { s.insert(num); }
-void TriFuzzyNumSet::insert(TriFuzzyNum &&num) { s.insert(move(num)); }
-void TriFuzzyNumSet::remove(const TriFuzzyNum &num) {
+template<floating_point T, class Storage>
+void BasicTriFuzzyNumSet<T, Storage>::clear() {
+    s.clear();
+    sum_l = sum_m = sum_u = {};
+}
+
+template<floating_point T, class Storage>
+bool BasicTriFuzzyNumSet<T, Storage>::sums_overflowed() const {
+    return sum_l.overflowed() || sum_m.overflowed() || sum_u.overflowed();
+}
+
+template<floating_point T, class Storage>
+void BasicTriFuzzyNumSet<T, Storage>::recompute_sums() {
+    sum_l = sum_m = sum_u = {};
+    for (const auto &num : s) {
+        sum_l.add(num.lower_value());
+        sum_m.add(num.modal_value());
+        sum_u.add(num.upper_value());
+    }
+}
+
+template<floating_point T, class Storage>
+void BasicTriFuzzyNumSet<T, Storage>::insert(const value_type &num) { insert(value_type(num)); }
+template<floating_point T, class Storage>
+void BasicTriFuzzyNumSet<T, Storage>::insert(value_type &&num) {
+    sum_l.add(num.lower_value());
+    sum_m.add(num.modal_value());
+    sum_u.add(num.upper_value());
+    s.insert(move(num));
+}
+template<floating_point T, class Storage>
+void BasicTriFuzzyNumSet<T, Storage>::remove(const value_type &num) {
     // Deleting just one copy of the number
-    auto iter = s.find(num);
-    if (iter != s.end()) s.erase(iter);
+    auto removed = s.remove(num);
+    if (!removed) return;
+
+    sum_l.subtract(removed->lower_value());
+    sum_m.subtract(removed->modal_value());
+    sum_u.subtract(removed->upper_value());
+    // Dropping the rounding errors accumulated by the running sums.
+    if (s.size() == 0) clear();
+    // The sums may fit in the range again, this costs O(n) only while they are out of it.
+    else if (sums_overflowed()) recompute_sums();
 }
 
-TriFuzzyNum TriFuzzyNumSet::arithmetic_mean() const {
-    if (s.empty()) throw length_error("TriFuzzyNumSet::arithmetic_mean - the set is empty.");
+template<floating_point T, class Storage>
+size_t BasicTriFuzzyNumSet<T, Storage>::size() const { return s.size(); }
+
+// Iterates over the numbers in the order of rank.
+template<floating_point T, class Storage>
+typename BasicTriFuzzyNumSet<T, Storage>::const_iterator BasicTriFuzzyNumSet<T, Storage>::begin() const { return s.begin(); }
+template<floating_point T, class Storage>
+typename BasicTriFuzzyNumSet<T, Storage>::const_iterator BasicTriFuzzyNumSet<T, Storage>::end() const { return s.end(); }
 
-    real_t res_l = 0;
-    real_t res_m = 0;
-    real_t res_u = 0;
+template<floating_point T, class Storage>
+BasicTriFuzzyNum<T> BasicTriFuzzyNumSet<T, Storage>::arithmetic_mean() const {
+    if (s.size() == 0) throw length_error("TriFuzzyNumSet::arithmetic_mean - the set is empty.");
 
-    for (const auto & iter : s) {
-        res_l += iter.lower_value();
-        res_m += iter.modal_value();
-        res_u += iter.upper_value();
+    auto size = static_cast<T>(s.size());
+    if (sums_overflowed()) {
+        T res_l = 0;
+        T res_m = 0;
+        T res_u = 0;
+        for (const auto &num : s) {
+            res_l += num.lower_value();
+            res_m += num.modal_value();
+            res_u += num.upper_value();
+        }
+        return {res_l / size, res_m / size, res_u / size};
     }
+    return {sum_l.value() / size, sum_m.value() / size, sum_u.value() / size};
+}
+
+// Returns the k-th (counting from 0) number in the order of rank.
+template<floating_point T, class Storage>
+BasicTriFuzzyNum<T> BasicTriFuzzyNumSet<T, Storage>::kth_smallest(size_t k) const {
+    if (k >= s.size()) throw out_of_range("TriFuzzyNumSet::kth_smallest - k is out of range.");
+    return s.kth(k);
+}
+
+// Returns the lower median in the order of rank.
+template<floating_point T, class Storage>
+BasicTriFuzzyNum<T> BasicTriFuzzyNumSet<T, Storage>::median() const {
+    if (s.size() == 0) throw length_error("TriFuzzyNumSet::median - the set is empty.");
+    return kth_smallest((s.size() - 1) / 2);
+}
+
+// Returns the p-th percentile (0 <= p <= 100) in the order of rank, using the nearest-rank method.
+template<floating_point T, class Storage>
+BasicTriFuzzyNum<T> BasicTriFuzzyNumSet<T, Storage>::percentile(T p) const {
+    if (s.size() == 0) throw length_error("TriFuzzyNumSet::percentile - the set is empty.");
+    if (!(p >= 0 && p <= 100)) throw out_of_range("TriFuzzyNumSet::percentile - p is out of range.");
 
-    auto size = static_cast<real_t>(s.size());
-    res_l /= size;
-    res_m /= size;
-    res_u /= size;
-    return {res_l, res_m, res_u};
+    auto rank = static_cast<size_t>(ceil(p / 100 * static_cast<T>(s.size())));
+    return kth_smallest(rank == 0 ? 0 : min(rank, s.size()) - 1);
 }
 
 #endif // FUZZY_H
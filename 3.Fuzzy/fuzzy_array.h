@@ -0,0 +1,377 @@
+#ifndef FUZZY_ARRAY_H
+#define FUZZY_ARRAY_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+#include <stdexcept>
+#include <initializer_list>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#include "fuzzy.h"
+#include "fuzzy_expr.h"
+
+namespace utils {
+    // Allocator returning memory aligned to Alignment bytes (the width of a SIMD register).
+    template<class T, size_t Alignment>
+    struct aligned_allocator {
+        using value_type = T;
+
+        template<class U>
+        struct rebind {
+            using other = aligned_allocator<U, Alignment>;
+        };
+
+        constexpr aligned_allocator() noexcept = default;
+        template<class U>
+        constexpr aligned_allocator(const aligned_allocator<U, Alignment>&) noexcept { }
+
+        T* allocate(size_t n) {
+            return static_cast<T*>(::operator new(n * sizeof(T), align_val_t(Alignment)));
+        }
+
+        void deallocate(T *p, size_t) noexcept {
+            ::operator delete(p, align_val_t(Alignment));
+        }
+
+        template<class U>
+        constexpr bool operator==(const aligned_allocator<U, Alignment>&) const noexcept { return true; }
+    };
+
+    template<fuzzy_op Op, floating_point T>
+    inline void apply_one(T l1, T m1, T u1, T l2, T m2, T u2, T &l, T &m, T &u) {
+        T a, b, c;
+        if constexpr (Op == fuzzy_op::add) {
+            a = l1 + l2; b = m1 + m2; c = u1 + u2;
+        }
+        else if constexpr (Op == fuzzy_op::sub) {
+            a = l1 - u2; b = m1 - m2; c = u1 - l2;
+        }
+        else {
+            a = l1 * l2; b = m1 * m2; c = u1 * u2;
+        }
+        l = min_of_3(a, b, c);
+        m = mid_of_3(a, b, c);
+        u = max_of_3(a, b, c);
+    }
+
+    template<floating_point T>
+    inline void rank_one(T l, T m, T u, T &r1, T &r2, T &r3) {
+        T x = calc_x(l, m, u);
+        T y = calc_y(l, m, u);
+        r1 = x - y / 2;
+        r2 = 1 - y;
+        r3 = m;
+    }
+
+    // Thin wrappers over the SIMD instructions for the value type T.
+    // Types without a specialization (long double) are processed by the scalar loops only.
+    template<floating_point T>
+    struct simd { };
+
+    template<class T>
+    concept has_simd = requires { simd<T>::width; };
+
+#if defined(__AVX2__)
+    // The SIMD kernels repeat the scalar formulas operation by operation, so the results are
+    // bitwise identical as long as the compiler does not contract the scalar ones into FMAs
+    // (compile with -ffp-contract=off if FMA is enabled).
+    // min and max take their operands swapped, to behave as std::min and std::max on NaN.
+    template<>
+    struct simd<double> {
+        using reg = __m256d;
+        static constexpr size_t width = 4;
+
+        static reg load(const double *p) { return _mm256_loadu_pd(p); }
+        static void store(double *p, reg a) { _mm256_storeu_pd(p, a); }
+        static reg set1(double v) { return _mm256_set1_pd(v); }
+        static reg add(reg a, reg b) { return _mm256_add_pd(a, b); }
+        static reg sub(reg a, reg b) { return _mm256_sub_pd(a, b); }
+        static reg mul(reg a, reg b) { return _mm256_mul_pd(a, b); }
+        static reg div(reg a, reg b) { return _mm256_div_pd(a, b); }
+        static reg sqrt(reg a) { return _mm256_sqrt_pd(a); }
+        static reg min(reg a, reg b) { return _mm256_min_pd(b, a); }
+        static reg max(reg a, reg b) { return _mm256_max_pd(b, a); }
+        static reg le(reg a, reg b) { return _mm256_cmp_pd(a, b, _CMP_LE_OQ); }
+        // mask ? b : a
+        static reg blend(reg a, reg b, reg mask) { return _mm256_blendv_pd(a, b, mask); }
+    };
+
+    template<>
+    struct simd<float> {
+        using reg = __m256;
+        static constexpr size_t width = 8;
+
+        static reg load(const float *p) { return _mm256_loadu_ps(p); }
+        static void store(float *p, reg a) { _mm256_storeu_ps(p, a); }
+        static reg set1(float v) { return _mm256_set1_ps(v); }
+        static reg add(reg a, reg b) { return _mm256_add_ps(a, b); }
+        static reg sub(reg a, reg b) { return _mm256_sub_ps(a, b); }
+        static reg mul(reg a, reg b) { return _mm256_mul_ps(a, b); }
+        static reg div(reg a, reg b) { return _mm256_div_ps(a, b); }
+        static reg sqrt(reg a) { return _mm256_sqrt_ps(a); }
+        static reg min(reg a, reg b) { return _mm256_min_ps(b, a); }
+        static reg max(reg a, reg b) { return _mm256_max_ps(b, a); }
+        static reg le(reg a, reg b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+        // mask ? b : a
+        static reg blend(reg a, reg b, reg mask) { return _mm256_blendv_ps(a, b, mask); }
+    };
+#endif
+
+    template<floating_point T, class R = typename simd<T>::reg>
+    inline void sort_3(R a, R b, R c, T *l, T *m, T *u) {
+        using S = simd<T>;
+        R ab = S::le(a, b);
+        R bc = S::le(b, c);
+        R ac = S::le(a, c);
+        // Branches of mid_of_3: a <= b ? (b <= c ? b : (a <= c ? c : a)) : (a <= c ? a : (b <= c ? c : b))
+        R if_ab = S::blend(S::blend(a, c, ac), b, bc);
+        R if_not_ab = S::blend(S::blend(b, c, bc), a, ac);
+
+        S::store(l, S::min(S::min(a, b), c));
+        S::store(m, S::blend(if_not_ab, if_ab, ab));
+        S::store(u, S::max(S::max(a, b), c));
+    }
+
+    // Element-wise arithmetic of n fuzzy numbers stored as separate l, m and u arrays.
+    // The result (which may alias the first operand) is normalized exactly as the
+    // BasicTriFuzzyNum constructor normalizes it.
+    template<fuzzy_op Op, floating_point T>
+    void apply_n(const T *l1, const T *m1, const T *u1, const T *l2, const T *m2, const T *u2,
+                 T *l, T *m, T *u, size_t n) {
+        size_t i = 0;
+        if constexpr (has_simd<T>) {
+            using S = simd<T>;
+            for (; i + S::width <= n; i += S::width) {
+                auto vl1 = S::load(l1 + i), vm1 = S::load(m1 + i), vu1 = S::load(u1 + i);
+                auto vl2 = S::load(l2 + i), vm2 = S::load(m2 + i), vu2 = S::load(u2 + i);
+                if constexpr (Op == fuzzy_op::add) {
+                    sort_3(S::add(vl1, vl2), S::add(vm1, vm2), S::add(vu1, vu2), l + i, m + i, u + i);
+                }
+                else if constexpr (Op == fuzzy_op::sub) {
+                    sort_3(S::sub(vl1, vu2), S::sub(vm1, vm2), S::sub(vu1, vl2), l + i, m + i, u + i);
+                }
+                else {
+                    sort_3(S::mul(vl1, vl2), S::mul(vm1, vm2), S::mul(vu1, vu2), l + i, m + i, u + i);
+                }
+            }
+        }
+        for (; i < n; i++) {
+            apply_one<Op>(l1[i], m1[i], u1[i], l2[i], m2[i], u2[i], l[i], m[i], u[i]);
+        }
+    }
+
+    // Computes the rank of n fuzzy numbers, the same tuple as BasicTriFuzzyNum compares.
+    template<floating_point T>
+    void rank_n(const T *l, const T *m, const T *u, T *r1, T *r2, T *r3, size_t n) {
+        size_t i = 0;
+        if constexpr (has_simd<T>) {
+            using S = simd<T>;
+            const auto one = S::set1(1);
+            const auto two = S::set1(2);
+            for (; i + S::width <= n; i += S::width) {
+                auto vl = S::load(l + i), vm = S::load(m + i), vu = S::load(u + i);
+                auto d = S::sub(vu, vl);
+                auto um = S::sub(vu, vm);
+                auto ml = S::sub(vm, vl);
+                auto s1 = S::sqrt(S::add(one, S::mul(um, um)));
+                auto s2 = S::sqrt(S::add(one, S::mul(ml, ml)));
+                auto z = S::add(S::add(d, s1), s2);
+                auto x = S::div(S::add(S::add(S::mul(d, vm), S::mul(s1, vl)), S::mul(s2, vu)), z);
+                auto y = S::div(d, z);
+
+                S::store(r1 + i, S::sub(x, S::div(y, two)));
+                S::store(r2 + i, S::sub(one, y));
+                S::store(r3 + i, vm);
+            }
+        }
+        for (; i < n; i++) {
+            rank_one(l[i], m[i], u[i], r1[i], r2[i], r3[i]);
+        }
+    }
+}
+
+/* ----- ARRAY ----- */
+
+// Sequence of fuzzy numbers stored as three separate aligned arrays of the lower,
+// modal and upper values. The ranks are not stored and computed in batches by ranks().
+template<floating_point T>
+class BasicTriFuzzyNumArray {
+    public:
+        using value_type = BasicTriFuzzyNum<T>;
+        using storage_t = vector<T, utils::aligned_allocator<T, 32>>;
+
+        struct Ranks {
+            storage_t first;
+            storage_t second;
+            storage_t third;
+        };
+
+        BasicTriFuzzyNumArray();
+        BasicTriFuzzyNumArray(size_t n, const value_type &num = basic_crisp_zero<T>);
+        BasicTriFuzzyNumArray(initializer_list<value_type> args);
+        template<utils::fuzzy_expression E> requires (!E::is_scalar)
+        BasicTriFuzzyNumArray(const E &expr);
+        template<utils::fuzzy_expression E> requires (!E::is_scalar)
+        BasicTriFuzzyNumArray& operator=(const E &expr);
+        size_t size() const;
+        bool empty() const;
+        void reserve(size_t n);
+        void push_back(const value_type &num);
+        value_type operator[](size_t i) const;
+        void set(size_t i, const value_type &num);
+        const T* lower_values() const;
+        const T* modal_values() const;
+        const T* upper_values() const;
+        BasicTriFuzzyNumArray& operator+=(const BasicTriFuzzyNumArray &other);
+        BasicTriFuzzyNumArray operator+(const BasicTriFuzzyNumArray &other) const;
+        BasicTriFuzzyNumArray& operator-=(const BasicTriFuzzyNumArray &other);
+        BasicTriFuzzyNumArray operator-(const BasicTriFuzzyNumArray &other) const;
+        BasicTriFuzzyNumArray& operator*=(const BasicTriFuzzyNumArray &other);
+        BasicTriFuzzyNumArray operator*(const BasicTriFuzzyNumArray &other) const;
+        Ranks ranks() const;
+    private:
+        storage_t l;
+        storage_t m;
+        storage_t u;
+
+        template<utils::fuzzy_op Op>
+        BasicTriFuzzyNumArray& apply(const BasicTriFuzzyNumArray &other);
+};
+
+using TriFuzzyNumArray = BasicTriFuzzyNumArray<real_t>;
+
+// The array as an operand of a fused expression, see fuzzy_expr.h.
+template<floating_point T>
+utils::fuzzy_soa_leaf<T> fuse(const BasicTriFuzzyNumArray<T> &arr) {
+    return {arr.lower_values(), arr.modal_values(), arr.upper_values(), arr.size()};
+}
+// The expression references the array, so it must not be a temporary.
+template<floating_point T>
+void fuse(const BasicTriFuzzyNumArray<T> &&arr) = delete;
+
+template<floating_point T>
+BasicTriFuzzyNumArray<T>::BasicTriFuzzyNumArray() = default;
+template<floating_point T>
+BasicTriFuzzyNumArray<T>::BasicTriFuzzyNumArray(size_t n, const value_type &num) : l(n, num.lower_value()),
+                                                                                   m(n, num.modal_value()),
+                                                                                   u(n, num.upper_value()) { }
+template<floating_point T>
+BasicTriFuzzyNumArray<T>::BasicTriFuzzyNumArray(initializer_list<value_type> args) {
+    reserve(args.size());
+    for (const auto &num : args) push_back(num);
+}
+
+template<floating_point T>
+template<utils::fuzzy_expression E> requires (!E::is_scalar)
+BasicTriFuzzyNumArray<T>::BasicTriFuzzyNumArray(const E &expr) {
+    *this = expr;
+}
+
+// Evaluates the expression in one pass. The array may be one of its operands,
+// as every element is read before it is written.
+template<floating_point T>
+template<utils::fuzzy_expression E> requires (!E::is_scalar)
+BasicTriFuzzyNumArray<T>& BasicTriFuzzyNumArray<T>::operator=(const E &expr) {
+    static_assert(same_as<typename E::value_type, T>, "TriFuzzyNumArray - the expression differs in the value type.");
+
+    size_t n = expr.size();
+    if (n != size()) {
+        // The array is not an operand of the expression, as its size differs.
+        l.resize(n);
+        m.resize(n);
+        u.resize(n);
+    }
+
+    T *pl = l.data(), *pm = m.data(), *pu = u.data();
+    for (size_t i = 0; i < n; i++) {
+        auto res = expr.eval(i);
+        pl[i] = res.l;
+        pm[i] = res.m;
+        pu[i] = res.u;
+    }
+    return *this;
+}
+
+template<floating_point T>
+size_t BasicTriFuzzyNumArray<T>::size() const { return l.size(); }
+template<floating_point T>
+bool BasicTriFuzzyNumArray<T>::empty() const { return l.empty(); }
+
+template<floating_point T>
+void BasicTriFuzzyNumArray<T>::reserve(size_t n) {
+    l.reserve(n);
+    m.reserve(n);
+    u.reserve(n);
+}
+
+template<floating_point T>
+void BasicTriFuzzyNumArray<T>::push_back(const value_type &num) {
+    l.push_back(num.lower_value());
+    m.push_back(num.modal_value());
+    u.push_back(num.upper_value());
+}
+
+template<floating_point T>
+BasicTriFuzzyNum<T> BasicTriFuzzyNumArray<T>::operator[](size_t i) const { return {l[i], m[i], u[i]}; }
+
+template<floating_point T>
+void BasicTriFuzzyNumArray<T>::set(size_t i, const value_type &num) {
+    l[i] = num.lower_value();
+    m[i] = num.modal_value();
+    u[i] = num.upper_value();
+}
+
+template<floating_point T>
+const T* BasicTriFuzzyNumArray<T>::lower_values() const { return l.data(); }
+template<floating_point T>
+const T* BasicTriFuzzyNumArray<T>::modal_values() const { return m.data(); }
+template<floating_point T>
+const T* BasicTriFuzzyNumArray<T>::upper_values() const { return u.data(); }
+
+template<floating_point T>
+template<utils::fuzzy_op Op>
+BasicTriFuzzyNumArray<T>& BasicTriFuzzyNumArray<T>::apply(const BasicTriFuzzyNumArray &other) {
+    if (size() != other.size()) throw length_error("TriFuzzyNumArray - the arrays differ in size.");
+
+    utils::apply_n<Op>(l.data(), m.data(), u.data(), other.l.data(), other.m.data(), other.u.data(),
+                       l.data(), m.data(), u.data(), size());
+    return *this;
+}
+
+template<floating_point T>
+BasicTriFuzzyNumArray<T>& BasicTriFuzzyNumArray<T>::operator+=(const BasicTriFuzzyNumArray &other) {
+    return apply<utils::fuzzy_op::add>(other);
+}
+template<floating_point T>
+BasicTriFuzzyNumArray<T> BasicTriFuzzyNumArray<T>::operator+(const BasicTriFuzzyNumArray &other) const {
+    return BasicTriFuzzyNumArray(*this) += other;
+}
+
+template<floating_point T>
+BasicTriFuzzyNumArray<T>& BasicTriFuzzyNumArray<T>::operator-=(const BasicTriFuzzyNumArray &other) {
+    return apply<utils::fuzzy_op::sub>(other);
+}
+template<floating_point T>
+BasicTriFuzzyNumArray<T> BasicTriFuzzyNumArray<T>::operator-(const BasicTriFuzzyNumArray &other) const {
+    return BasicTriFuzzyNumArray(*this) -= other;
+}
+
+template<floating_point T>
+BasicTriFuzzyNumArray<T>& BasicTriFuzzyNumArray<T>::operator*=(const BasicTriFuzzyNumArray &other) {
+    return apply<utils::fuzzy_op::mul>(other);
+}
+template<floating_point T>
+BasicTriFuzzyNumArray<T> BasicTriFuzzyNumArray<T>::operator*(const BasicTriFuzzyNumArray &other) const {
+    return BasicTriFuzzyNumArray(*this) *= other;
+}
+
+template<floating_point T>
+typename BasicTriFuzzyNumArray<T>::Ranks BasicTriFuzzyNumArray<T>::ranks() const {
+    Ranks res{storage_t(size()), storage_t(size()), storage_t(size())};
+    utils::rank_n(l.data(), m.data(), u.data(), res.first.data(), res.second.data(), res.third.data(), size());
+    return res;
+}
+
+#endif // FUZZY_ARRAY_H
@@ -0,0 +1,247 @@
+// Benchmark of the Fuzzy module.
+//
+// Build:
+//   g++ -std=c++20 -O2 fuzzy_bench.cc -o fuzzy_bench
+// Add -mavx2 to measure the SIMD kernels of TriFuzzyNumArray.
+//
+// Usage: ./fuzzy_bench [scale]
+// The scale (default 1) multiplies the number of repetitions of every workload.
+//
+// Every workload reports the time and the number of heap allocations per operation,
+// the allocations are counted by the replaced global operator new.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include "fuzzy.h"
+#include "fuzzy_array.h"
+#include "fuzzy_expr.h"
+
+namespace {
+    size_t allocations = 0;
+
+    void* allocate(size_t size, size_t alignment) {
+        allocations++;
+        void *p = alignment <= alignof(max_align_t) ? malloc(size ? size : 1)
+                                                    : aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+        if (!p) throw bad_alloc();
+        return p;
+    }
+}
+
+void* operator new(size_t size) { return allocate(size, alignof(max_align_t)); }
+void* operator new[](size_t size) { return allocate(size, alignof(max_align_t)); }
+void* operator new(size_t size, align_val_t al) { return allocate(size, static_cast<size_t>(al)); }
+void* operator new[](size_t size, align_val_t al) { return allocate(size, static_cast<size_t>(al)); }
+void operator delete(void *p) noexcept { free(p); }
+void operator delete[](void *p) noexcept { free(p); }
+void operator delete(void *p, size_t) noexcept { free(p); }
+void operator delete[](void *p, size_t) noexcept { free(p); }
+void operator delete(void *p, align_val_t) noexcept { free(p); }
+void operator delete[](void *p, align_val_t) noexcept { free(p); }
+void operator delete(void *p, size_t, align_val_t) noexcept { free(p); }
+void operator delete[](void *p, size_t, align_val_t) noexcept { free(p); }
+
+namespace {
+    using bench_clock = chrono::steady_clock;
+
+    // Keeps the compiler from optimizing the measured computation away.
+    template<class T>
+    void keep(const T &value) {
+        asm volatile("" : : "r"(&value) : "memory");
+    }
+
+    // Runs f(), which performs ops operations, and prints the cost of one operation.
+    template<class F>
+    void measure(const char *name, size_t size, size_t ops, F &&f) {
+        size_t allocations_before = allocations;
+        auto before = bench_clock::now();
+        f();
+        auto after = bench_clock::now();
+        size_t allocated = allocations - allocations_before;
+
+        double ns = chrono::duration<double, nano>(after - before).count();
+        printf("%-26s %10zu %12zu %10.2f %12.3f\n", name, size, ops, ns / ops,
+               static_cast<double>(allocated) / ops);
+    }
+
+    mt19937_64 rng(2022);
+
+    vector<TriFuzzyNum> random_numbers(size_t count) {
+        uniform_real_distribution<real_t> dist(-100, 100);
+        vector<TriFuzzyNum> res;
+        res.reserve(count);
+        for (size_t i = 0; i < count; i++) res.emplace_back(dist(rng), dist(rng), dist(rng));
+        return res;
+    }
+
+    // The raw values of the numbers, so that construction is measured on its own.
+    vector<real_t> random_values(size_t count) {
+        uniform_real_distribution<real_t> dist(-100, 100);
+        vector<real_t> res(count * 3);
+        for (auto &v : res) v = dist(rng);
+        return res;
+    }
+
+    void construction(size_t size, size_t reps) {
+        auto values = random_values(size);
+        measure("construct", size, size * reps, [&] {
+            for (size_t r = 0; r < reps; r++) {
+                for (size_t i = 0; i < size; i++) {
+                    TriFuzzyNum num(values[3 * i], values[3 * i + 1], values[3 * i + 2]);
+                    keep(num);
+                }
+            }
+        });
+    }
+
+    void arithmetic(size_t size, size_t reps) {
+        auto a = random_numbers(size);
+        auto b = random_numbers(size);
+
+        measure("operator+", size, size * reps, [&] {
+            for (size_t r = 0; r < reps; r++) {
+                for (size_t i = 0; i < size; i++) keep(a[i] + b[i]);
+            }
+        });
+        measure("operator-", size, size * reps, [&] {
+            for (size_t r = 0; r < reps; r++) {
+                for (size_t i = 0; i < size; i++) keep(a[i] - b[i]);
+            }
+        });
+        measure("operator*", size, size * reps, [&] {
+            for (size_t r = 0; r < reps; r++) {
+                for (size_t i = 0; i < size; i++) keep(a[i] * b[i]);
+            }
+        });
+        measure("a * b + a - b (eager)", size, size * reps, [&] {
+            for (size_t r = 0; r < reps; r++) {
+                for (size_t i = 0; i < size; i++) keep(a[i] * b[i] + a[i] - b[i]);
+            }
+        });
+        measure("a * b + a - b (fused)", size, size * reps, [&] {
+            for (size_t r = 0; r < reps; r++) {
+                for (size_t i = 0; i < size; i++) keep(TriFuzzyNum(fuse(a[i]) * b[i] + a[i] - b[i]));
+            }
+        });
+    }
+
+    // Fresh copies for every repetition, so that the ranks are not cached yet.
+    void comparison(size_t size, size_t reps) {
+        auto a = random_numbers(size);
+        auto b = random_numbers(size);
+
+        measure("operator< (uncached)", size, size * reps, [&] {
+            for (size_t r = 0; r < reps; r++) {
+                for (size_t i = 0; i < size; i++) {
+                    TriFuzzyNum x(a[i].lower_value(), a[i].modal_value(), a[i].upper_value());
+                    TriFuzzyNum y(b[i].lower_value(), b[i].modal_value(), b[i].upper_value());
+                    keep(x < y);
+                }
+            }
+        });
+        measure("operator< (cached)", size, size * reps, [&] {
+            for (size_t r = 0; r < reps; r++) {
+                for (size_t i = 0; i < size; i++) keep(a[i] < b[i]);
+            }
+        });
+        measure("operator==", size, size * reps, [&] {
+            for (size_t r = 0; r < reps; r++) {
+                for (size_t i = 0; i < size; i++) keep(a[i] == b[i]);
+            }
+        });
+    }
+
+    // Run on TriFuzzyNumSet and on TriFuzzyNumFlatSet, with the names prefixed by kind.
+    template<class Set>
+    void set_operations(const string &kind, size_t size, size_t reps) {
+        auto nums = random_numbers(size);
+        vector<Set> sets(reps);
+
+        measure((kind + " insert").c_str(), size, size * reps, [&] {
+            for (auto &set : sets) {
+                for (const auto &num : nums) set.insert(num);
+            }
+        });
+        measure((kind + " arithmetic_mean").c_str(), size, reps, [&] {
+            for (const auto &set : sets) keep(set.arithmetic_mean());
+        });
+        measure((kind + " median").c_str(), size, reps, [&] {
+            for (const auto &set : sets) keep(set.median());
+        });
+        // Walks all of the numbers in the order of rank, the flat storage merges its buffer
+        // in the median above already.
+        measure((kind + " iterate").c_str(), size, size * reps, [&] {
+            for (const auto &set : sets) {
+                real_t sum = 0;
+                for (const auto &num : set) sum += num.modal_value();
+                keep(sum);
+            }
+        });
+        measure((kind + " kth_smallest").c_str(), size, size * reps, [&] {
+            for (const auto &set : sets) {
+                for (size_t k = 0; k < size; k++) keep(set.kth_smallest(k));
+            }
+        });
+        // Removal from the sorted vector storage costs O(size), so only a part is removed.
+        size_t removed = min<size_t>(size, 1000);
+        measure((kind + " remove").c_str(), size, removed * reps, [&] {
+            for (auto &set : sets) {
+                for (size_t i = 0; i < removed; i++) set.remove(nums[i]);
+            }
+        });
+    }
+
+    void array_operations(size_t size, size_t reps) {
+        auto a_nums = random_numbers(size);
+        auto b_nums = random_numbers(size);
+        TriFuzzyNumArray a, b;
+        for (size_t i = 0; i < size; i++) {
+            a.push_back(a_nums[i]);
+            b.push_back(b_nums[i]);
+        }
+        // The sums grow by b on every repetition, which does not change the cost of the kernel.
+        TriFuzzyNumArray res = a;
+
+        measure("array +=", size, size * reps, [&] {
+            for (size_t r = 0; r < reps; r++) {
+                res += b;
+                keep(res);
+            }
+        });
+        measure("array ranks", size, size * reps, [&] {
+            for (size_t r = 0; r < reps; r++) keep(a.ranks());
+        });
+        measure("array a * b + a (fused)", size, size * reps, [&] {
+            for (size_t r = 0; r < reps; r++) {
+                res = fuse(a) * b + a;
+                keep(res);
+            }
+        });
+    }
+}
+
+int main(int argc, char *argv[]) {
+    size_t scale = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1;
+    if (scale == 0) scale = 1;
+
+    printf("%-26s %10s %12s %10s %12s\n", "workload", "size", "ops", "ns/op", "allocs/op");
+
+    for (size_t size : {1000, 10000, 100000, 1000000}) {
+        // Roughly the same number of operations for every size.
+        size_t reps = max<size_t>(1, 1000000 / size) * scale;
+
+        construction(size, reps);
+        arithmetic(size, reps);
+        comparison(size, reps);
+        set_operations<TriFuzzyNumSet>("set", size, max<size_t>(1, reps / 10));
+        set_operations<TriFuzzyNumFlatSet>("flat set", size, max<size_t>(1, reps / 10));
+        array_operations(size, reps);
+    }
+
+    return 0;
+}
@@ -0,0 +1,171 @@
+#ifndef FUZZY_EXPR_H
+#define FUZZY_EXPR_H
+
+#include <cstddef>
+#include <concepts>
+#include <stdexcept>
+#include "fuzzy.h"
+
+// Expression templates for fuzzy arithmetic. fuse(x) wraps a number (or an array, see
+// fuzzy_array.h) and the arithmetic operators on the wrapped values build an expression
+// tree instead of temporaries. The tree is evaluated once, when it is converted to a
+// number or assigned to an array, element by element in one pass over the operands.
+// Every operation is normalized exactly as the eager operators normalize it, so the
+// results are the same, but the rank is computed only for the final number.
+//
+// Numbers are copied into the tree, arrays are referenced and must outlive it.
+
+namespace utils {
+    enum class fuzzy_op { add, sub, mul };
+
+    // Lower, modal and upper value of a possibly intermediate result.
+    template<floating_point T>
+    struct fuzzy_triple {
+        T l;
+        T m;
+        T u;
+    };
+
+    template<class E>
+    concept fuzzy_expression = requires(const E &e, size_t i) {
+        typename E::value_type;
+        { E::is_scalar } -> convertible_to<bool>;
+        { e.eval(i) } -> same_as<fuzzy_triple<typename E::value_type>>;
+    };
+
+    // Sorts the values as the BasicTriFuzzyNum constructor does. Sums and differences of
+    // normalized numbers are mostly ordered already, then the sorting is skipped. The check
+    // is strict, as with ties the sorting may pick the other of -0 and +0.
+    // Forced inline, as otherwise the triple is returned through memory at every node.
+    template<bool MaybeOrdered, floating_point T>
+    [[gnu::always_inline]] inline fuzzy_triple<T> normalize(T a, T b, T c) {
+        if constexpr (MaybeOrdered) {
+            if (a < b && b < c) return {a, b, c};
+        }
+        return {min_of_3(a, b, c), mid_of_3(a, b, c), max_of_3(a, b, c)};
+    }
+
+    // A single number, broadcast over the whole expression.
+    template<floating_point T>
+    class fuzzy_num_leaf {
+        public:
+            using value_type = T;
+            static constexpr bool is_scalar = true;
+
+            fuzzy_num_leaf(const BasicTriFuzzyNum<T> &num) : val{num.lower_value(), num.modal_value(),
+                                                                 num.upper_value()} { }
+
+            fuzzy_triple<T> eval(size_t) const { return val; }
+            operator BasicTriFuzzyNum<T>() const { return {val.l, val.m, val.u}; }
+
+        private:
+            fuzzy_triple<T> val;
+    };
+
+    // An array of numbers stored as separate lower, modal and upper values.
+    template<floating_point T>
+    class fuzzy_soa_leaf {
+        public:
+            using value_type = T;
+            static constexpr bool is_scalar = false;
+
+            fuzzy_soa_leaf(const T *l, const T *m, const T *u, size_t n) : l(l), m(m), u(u), n(n) { }
+
+            fuzzy_triple<T> eval(size_t i) const { return {l[i], m[i], u[i]}; }
+            size_t size() const { return n; }
+
+        private:
+            const T *l;
+            const T *m;
+            const T *u;
+            size_t n;
+    };
+
+    template<fuzzy_op Op, fuzzy_expression L, fuzzy_expression R>
+    class fuzzy_binary_expr {
+        public:
+            static_assert(same_as<typename L::value_type, typename R::value_type>,
+                          "fuzzy expression - the operands differ in the value type.");
+
+            using value_type = typename L::value_type;
+            static constexpr bool is_scalar = L::is_scalar && R::is_scalar;
+
+            fuzzy_binary_expr(const L &lhs, const R &rhs) : lhs(lhs), rhs(rhs) { }
+
+            fuzzy_triple<value_type> eval(size_t i) const {
+                auto a = lhs.eval(i);
+                auto b = rhs.eval(i);
+                if constexpr (Op == fuzzy_op::add) {
+                    return normalize<true>(a.l + b.l, a.m + b.m, a.u + b.u);
+                }
+                else if constexpr (Op == fuzzy_op::sub) {
+                    return normalize<true>(a.l - b.u, a.m - b.m, a.u - b.l);
+                }
+                else {
+                    return normalize<false>(a.l * b.l, a.m * b.m, a.u * b.u);
+                }
+            }
+
+            // Number of elements, the scalar operands are broadcast.
+            size_t size() const requires (!is_scalar) {
+                if constexpr (L::is_scalar) {
+                    return rhs.size();
+                }
+                else if constexpr (R::is_scalar) {
+                    return lhs.size();
+                }
+                else {
+                    if (lhs.size() != rhs.size()) throw length_error("fuzzy expression - the arrays differ in size.");
+                    return lhs.size();
+                }
+            }
+
+            operator BasicTriFuzzyNum<value_type>() const requires is_scalar {
+                auto res = eval(0);
+                return {res.l, res.m, res.u};
+            }
+
+        private:
+            L lhs;
+            R rhs;
+    };
+}
+
+template<floating_point T>
+utils::fuzzy_num_leaf<T> fuse(const BasicTriFuzzyNum<T> &num) { return num; }
+
+namespace utils {
+    template<class X>
+    concept fuzzy_operand = fuzzy_expression<X> || requires(const X &x) {
+        { fuse(x) } -> fuzzy_expression;
+    };
+
+    template<fuzzy_operand X>
+    auto as_expression(const X &x) {
+        if constexpr (fuzzy_expression<X>) return x;
+        else return fuse(x);
+    }
+
+    // At least one of the operands has to be fused already, the plain numbers and arrays
+    // keep their eager operators.
+    template<class L, class R>
+    concept fuzzy_fusable = fuzzy_operand<L> && fuzzy_operand<R> && (fuzzy_expression<L> || fuzzy_expression<R>);
+
+    template<fuzzy_op Op, class L, class R>
+    auto make_expression(const L &lhs, const R &rhs) {
+        auto a = as_expression(lhs);
+        auto b = as_expression(rhs);
+        return fuzzy_binary_expr<Op, decltype(a), decltype(b)>(a, b);
+    }
+
+    template<class L, class R> requires fuzzy_fusable<L, R>
+    auto operator+(const L &lhs, const R &rhs) { return make_expression<fuzzy_op::add>(lhs, rhs); }
+
+    template<class L, class R> requires fuzzy_fusable<L, R>
+    auto operator-(const L &lhs, const R &rhs) { return make_expression<fuzzy_op::sub>(lhs, rhs); }
+
+    template<class L, class R> requires fuzzy_fusable<L, R>
+    auto operator*(const L &lhs, const R &rhs) { return make_expression<fuzzy_op::mul>(lhs, rhs); }
+}
+
+#endif // FUZZY_EXPR_H
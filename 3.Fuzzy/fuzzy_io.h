@@ -0,0 +1,284 @@
+#ifndef FUZZY_IO_H
+#define FUZZY_IO_H
+
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "fuzzy.h"
+#include "fuzzy_array.h"
+
+// Text and binary I/O of fuzzy numbers in bulk.
+//
+// The text form is the one printed by operator<<, "(l, m, u)", with the numbers separated
+// by any whitespace. The writers print the shortest representation that reads back to the
+// same value.
+//
+// The binary form is a header (the magic "TFN", the format version, the size of a value
+// and the count of numbers) followed by the lower, modal and upper value of every number.
+// All fields are in the byte order of the machine that wrote them.
+
+namespace utils {
+    constexpr size_t io_buffer_size = 1 << 16;
+
+    inline bool is_space(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+    inline const char* skip_spaces(const char *first, const char *last) {
+        while (first != last && is_space(*first)) first++;
+        return first;
+    }
+
+    struct binary_header {
+        char magic[3];
+        uint8_t version;
+        uint32_t value_size;
+        uint64_t count;
+    };
+
+    constexpr char binary_magic[3] = {'T', 'F', 'N'};
+    constexpr uint8_t binary_version = 1;
+
+    // Parses the numbers of the text form from the stream and passes them to consume.
+    template<floating_point T, class F>
+    void read_text(istream &is, const F &consume) {
+        vector<char> buf(io_buffer_size);
+        size_t kept = 0;
+
+        while (true) {
+            is.read(buf.data() + kept, static_cast<streamsize>(buf.size() - kept));
+            size_t filled = kept + static_cast<size_t>(is.gcount());
+            bool eof = filled < buf.size();
+            const char *first = buf.data();
+            const char *last = first + filled;
+
+            // Parsing up to the last complete number, the rest is kept for the next read.
+            const char *end = last;
+            while (end != first && end[-1] != ')') end--;
+            if (eof) end = last;
+
+            while (true) {
+                first = skip_spaces(first, end);
+                if (first == end) break;
+
+                BasicTriFuzzyNum<T> num = crisp_number<T>(0);
+                auto [ptr, ec] = fuzzy_from_chars(first, end, num);
+                if (ec != errc()) throw invalid_argument("fuzzy_read_text - malformed fuzzy number.");
+                consume(move(num));
+                first = ptr;
+            }
+            if (eof) return;
+
+            kept = static_cast<size_t>(last - first);
+            if (kept == buf.size()) throw invalid_argument("fuzzy_read_text - malformed fuzzy number.");
+            memmove(buf.data(), first, kept);
+        }
+    }
+
+    // Prints the numbers of [first, last) in the text form, one per line.
+    template<class It>
+    void write_text(ostream &os, It first, It last) {
+        vector<char> buf(io_buffer_size);
+        // Enough for any number with three values of the longest floating point type.
+        constexpr size_t max_len = 256;
+        char *out = buf.data();
+
+        for (; first != last; ++first) {
+            if (static_cast<size_t>(buf.data() + buf.size() - out) < max_len) {
+                os.write(buf.data(), out - buf.data());
+                out = buf.data();
+            }
+            out = fuzzy_to_chars(out, buf.data() + buf.size(), *first).ptr;
+            *out++ = '\n';
+        }
+        os.write(buf.data(), out - buf.data());
+        if (!os) throw runtime_error("fuzzy_write_text - writing failed.");
+    }
+
+    template<floating_point T, class F>
+    void read_binary(istream &is, const F &consume) {
+        binary_header header;
+        if (!is.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+            memcmp(header.magic, binary_magic, sizeof(binary_magic)) != 0 || header.version != binary_version) {
+            throw invalid_argument("fuzzy_read_binary - not a fuzzy number stream.");
+        }
+        if (header.value_size != sizeof(T)) throw invalid_argument("fuzzy_read_binary - the value type differs.");
+
+        vector<T> buf(io_buffer_size / sizeof(T) / 3 * 3);
+        for (uint64_t left = header.count; left > 0; ) {
+            // The count is untrusted, so left * 3 may overflow.
+            size_t values = left < buf.size() / 3 ? static_cast<size_t>(left) * 3 : buf.size();
+            if (!is.read(reinterpret_cast<char*>(buf.data()), static_cast<streamsize>(values * sizeof(T)))) {
+                throw invalid_argument("fuzzy_read_binary - the stream is truncated.");
+            }
+            for (size_t i = 0; i < values; i += 3) consume(BasicTriFuzzyNum<T>(buf[i], buf[i + 1], buf[i + 2]));
+            left -= values / 3;
+        }
+    }
+
+    template<floating_point T, class It>
+    void write_binary(ostream &os, It first, It last, size_t count) {
+        binary_header header{};
+        memcpy(header.magic, binary_magic, sizeof(binary_magic));
+        header.version = binary_version;
+        header.value_size = sizeof(T);
+        header.count = count;
+        os.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+        vector<T> buf(io_buffer_size / sizeof(T) / 3 * 3);
+        size_t filled = 0;
+        for (; first != last; ++first) {
+            if (filled == buf.size()) {
+                os.write(reinterpret_cast<const char*>(buf.data()), static_cast<streamsize>(filled * sizeof(T)));
+                filled = 0;
+            }
+            const BasicTriFuzzyNum<T> &num = *first;
+            buf[filled++] = num.lower_value();
+            buf[filled++] = num.modal_value();
+            buf[filled++] = num.upper_value();
+        }
+        os.write(reinterpret_cast<const char*>(buf.data()), static_cast<streamsize>(filled * sizeof(T)));
+        if (!os) throw runtime_error("fuzzy_write_binary - writing failed.");
+    }
+
+    // Reads all of the numbers with read before appending them to the set or the array,
+    // so that the container is left unchanged if the stream is malformed.
+    template<floating_point T, class Storage, class Read>
+    void read_all(istream &is, BasicTriFuzzyNumSet<T, Storage> &set, const Read &read) {
+        BasicTriFuzzyNumArray<T> parsed;
+        read(is, [&](BasicTriFuzzyNum<T> &&num) { parsed.push_back(num); });
+        for (size_t i = 0; i < parsed.size(); i++) set.insert(parsed[i]);
+    }
+
+    template<floating_point T, class Read>
+    void read_all(istream &is, BasicTriFuzzyNumArray<T> &arr, const Read &read) {
+        BasicTriFuzzyNumArray<T> parsed;
+        read(is, [&](BasicTriFuzzyNum<T> &&num) { parsed.push_back(num); });
+        // After the reservation appending cannot throw, which gives the strong guarantee.
+        arr.reserve(arr.size() + parsed.size());
+        for (size_t i = 0; i < parsed.size(); i++) arr.push_back(parsed[i]);
+    }
+
+    // Iterates over an array, which stores no BasicTriFuzzyNum objects to refer to.
+    template<floating_point T>
+    class array_reader {
+        public:
+            array_reader(const BasicTriFuzzyNumArray<T> &arr, size_t i) : arr(&arr), i(i) { }
+
+            BasicTriFuzzyNum<T> operator*() const { return (*arr)[i]; }
+            array_reader& operator++() { i++; return *this; }
+            bool operator!=(const array_reader &other) const { return i != other.i; }
+
+        private:
+            const BasicTriFuzzyNumArray<T> *arr;
+            size_t i;
+    };
+}
+
+// Parses one number of the text form at the beginning of [first, last), like from_chars.
+// On failure the number is left unchanged and ec is errc::invalid_argument
+// (or errc::result_out_of_range if a value does not fit in T).
+template<floating_point T>
+from_chars_result fuzzy_from_chars(const char *first, const char *last, BasicTriFuzzyNum<T> &num) {
+    T values[3];
+    const char *p = utils::skip_spaces(first, last);
+    if (p == last || *p != '(') return {first, errc::invalid_argument};
+    p++;
+
+    for (int i = 0; i < 3; i++) {
+        p = utils::skip_spaces(p, last);
+        auto [ptr, ec] = from_chars(p, last, values[i]);
+        if (ec != errc()) return {first, ec};
+        p = utils::skip_spaces(ptr, last);
+        if (p == last || *p != (i < 2 ? ',' : ')')) return {first, errc::invalid_argument};
+        p++;
+    }
+
+    num = BasicTriFuzzyNum<T>(values[0], values[1], values[2]);
+    return {p, errc()};
+}
+
+// Prints the number in the text form to [first, last), like to_chars.
+template<floating_point T>
+to_chars_result fuzzy_to_chars(char *first, char *last, const BasicTriFuzzyNum<T> &num) {
+    const T values[3] = {num.lower_value(), num.modal_value(), num.upper_value()};
+    const char *separators[3] = {", ", ", ", ")"};
+
+    if (first == last) return {last, errc::value_too_large};
+    *first++ = '(';
+    for (int i = 0; i < 3; i++) {
+        auto [ptr, ec] = to_chars(first, last, values[i]);
+        if (ec != errc()) return {last, ec};
+        size_t len = strlen(separators[i]);
+        if (static_cast<size_t>(last - ptr) < len) return {last, errc::value_too_large};
+        first = copy_n(separators[i], len, ptr);
+    }
+    return {first, errc()};
+}
+
+template<floating_point T>
+istream& operator>>(istream &is, BasicTriFuzzyNum<T> &num) {
+    string text;
+    char c;
+    while (is.get(c)) {
+        if (text.empty() && utils::is_space(c)) continue;
+        text.push_back(c);
+        if (c == ')') break;
+    }
+
+    if (text.empty() || text.back() != ')' ||
+        fuzzy_from_chars(text.data(), text.data() + text.size(), num).ec != errc()) {
+        is.setstate(ios_base::failbit);
+    }
+    return is;
+}
+
+// The readers append the numbers of the stream to the set or the array. If the stream is
+// malformed, they throw invalid_argument and leave the set or the array unchanged.
+
+template<floating_point T, class Storage>
+void fuzzy_read_text(istream &is, BasicTriFuzzyNumSet<T, Storage> &set) {
+    utils::read_all(is, set, [](istream &in, const auto &consume) { utils::read_text<T>(in, consume); });
+}
+
+template<floating_point T>
+void fuzzy_read_text(istream &is, BasicTriFuzzyNumArray<T> &arr) {
+    utils::read_all(is, arr, [](istream &in, const auto &consume) { utils::read_text<T>(in, consume); });
+}
+
+template<floating_point T, class Storage>
+void fuzzy_write_text(ostream &os, const BasicTriFuzzyNumSet<T, Storage> &set) {
+    utils::write_text(os, set.begin(), set.end());
+}
+
+template<floating_point T>
+void fuzzy_write_text(ostream &os, const BasicTriFuzzyNumArray<T> &arr) {
+    utils::write_text(os, utils::array_reader<T>(arr, 0), utils::array_reader<T>(arr, arr.size()));
+}
+
+template<floating_point T, class Storage>
+void fuzzy_read_binary(istream &is, BasicTriFuzzyNumSet<T, Storage> &set) {
+    utils::read_all(is, set, [](istream &in, const auto &consume) { utils::read_binary<T>(in, consume); });
+}
+
+template<floating_point T>
+void fuzzy_read_binary(istream &is, BasicTriFuzzyNumArray<T> &arr) {
+    utils::read_all(is, arr, [](istream &in, const auto &consume) { utils::read_binary<T>(in, consume); });
+}
+
+template<floating_point T, class Storage>
+void fuzzy_write_binary(ostream &os, const BasicTriFuzzyNumSet<T, Storage> &set) {
+    utils::write_binary<T>(os, set.begin(), set.end(), set.size());
+}
+
+template<floating_point T>
+void fuzzy_write_binary(ostream &os, const BasicTriFuzzyNumArray<T> &arr) {
+    utils::write_binary<T>(os, utils::array_reader<T>(arr, 0), utils::array_reader<T>(arr, arr.size()), arr.size());
+}
+
+#endif // FUZZY_IO_H
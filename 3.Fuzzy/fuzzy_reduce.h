@@ -0,0 +1,197 @@
+#ifndef FUZZY_REDUCE_H
+#define FUZZY_REDUCE_H
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <iterator>
+#include <stdexcept>
+#include "fuzzy.h"
+#include "fuzzy_array.h"
+
+// Parallel reductions over ranges of fuzzy numbers. The input is split into blocks of
+// a fixed size and every sum is a pairwise sum over a tree that depends only on the
+// number of elements, so the result is the same for any number of threads.
+// threads == 0 uses all of the hardware threads. The threads are started anew by every call
+// and there is at most one per block, so ranges of a single block run on the calling thread.
+
+namespace utils {
+    constexpr size_t reduce_block = 1 << 14;
+    constexpr size_t pairwise_base = 32;
+
+    template<floating_point T>
+    struct fuzzy_sums {
+        T l = 0;
+        T m = 0;
+        T u = 0;
+    };
+
+    template<floating_point T>
+    fuzzy_sums<T> operator+(const fuzzy_sums<T> &a, const fuzzy_sums<T> &b) {
+        return {a.l + b.l, a.m + b.m, a.u + b.u};
+    }
+
+    // Value type of the fuzzy numbers in a range.
+    template<class It>
+    using range_value_t = typename iter_value_t<It>::value_type;
+
+    // Pairwise sum of get(first), ..., get(last - 1), the error grows as O(log n) instead of O(n).
+    template<class Get, class Sums = invoke_result_t<const Get&, size_t>>
+    Sums pairwise_sum(const Get &get, size_t first, size_t last) {
+        if (last - first <= pairwise_base) {
+            Sums res;
+            for (size_t i = first; i < last; i++) res = res + get(i);
+            return res;
+        }
+        size_t mid = first + (last - first) / 2;
+        return pairwise_sum(get, first, mid) + pairwise_sum(get, mid, last);
+    }
+
+    // Calls f(block) for every block < blocks, spreading the blocks over the threads.
+    // The started threads are joined even if starting another one throws.
+    template<class F>
+    void parallel_blocks(size_t blocks, unsigned threads, const F &f) {
+        if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+        threads = static_cast<unsigned>(min<size_t>(threads, blocks));
+
+        atomic<size_t> next(0);
+        auto work = [&] {
+            for (size_t block; (block = next.fetch_add(1, memory_order_relaxed)) < blocks; ) f(block);
+        };
+
+        vector<jthread> workers;
+        for (unsigned i = 1; i < threads; i++) workers.emplace_back(work);
+        work();
+    }
+
+    template<class Get, class Sums = invoke_result_t<const Get&, size_t>>
+    Sums parallel_sum(const Get &get, size_t n, unsigned threads) {
+        size_t blocks = (n + reduce_block - 1) / reduce_block;
+        vector<Sums> partial(blocks);
+
+        parallel_blocks(blocks, threads, [&](size_t block) {
+            partial[block] = pairwise_sum(get, block * reduce_block, min(n, (block + 1) * reduce_block));
+        });
+        return pairwise_sum([&](size_t i) { return partial[i]; }, 0, blocks);
+    }
+
+    // Index of the first number of the smallest (Less = less) or the largest (Less = greater) rank.
+    template<class It, class Less>
+    size_t parallel_extreme(It first, size_t n, unsigned threads, Less less) {
+        if (n == 0) throw length_error("fuzzy reduction - the range is empty.");
+
+        size_t blocks = (n + reduce_block - 1) / reduce_block;
+        vector<size_t> partial(blocks);
+
+        parallel_blocks(blocks, threads, [&](size_t block) {
+            size_t best = block * reduce_block;
+            for (size_t i = best + 1; i < min(n, (block + 1) * reduce_block); i++) {
+                if (less(first[i], first[best])) best = i;
+            }
+            partial[block] = best;
+        });
+
+        size_t best = partial[0];
+        for (size_t i = 1; i < blocks; i++) {
+            if (less(first[partial[i]], first[best])) best = partial[i];
+        }
+        return best;
+    }
+
+    template<class It, floating_point T = range_value_t<It>>
+    fuzzy_sums<T> range_sum(It first, It last, unsigned threads) {
+        return parallel_sum([first](size_t i) {
+            const BasicTriFuzzyNum<T> &num = first[i];
+            return fuzzy_sums<T>{num.lower_value(), num.modal_value(), num.upper_value()};
+        }, static_cast<size_t>(last - first), threads);
+    }
+
+    template<floating_point T>
+    fuzzy_sums<T> array_sum(const BasicTriFuzzyNumArray<T> &arr, unsigned threads) {
+        const T *l = arr.lower_values(), *m = arr.modal_values(), *u = arr.upper_values();
+        return parallel_sum([=](size_t i) { return fuzzy_sums<T>{l[i], m[i], u[i]}; }, arr.size(), threads);
+    }
+
+    template<floating_point T>
+    BasicTriFuzzyNum<T> mean_of(const fuzzy_sums<T> &sums, size_t n) {
+        if (n == 0) throw length_error("fuzzy reduction - the range is empty.");
+        auto size = static_cast<T>(n);
+        return {sums.l / size, sums.m / size, sums.u / size};
+    }
+
+    // Sums the numbers of a set in place if its storage can be indexed, otherwise copies them first.
+    template<class It, floating_point T = range_value_t<It>>
+    fuzzy_sums<T> set_sum(It first, It last, size_t n, unsigned threads) {
+        if constexpr (random_access_iterator<It>) {
+            return range_sum(first, last, threads);
+        }
+        else {
+            BasicTriFuzzyNumArray<T> arr;
+            arr.reserve(n);
+            for (; first != last; ++first) arr.push_back(*first);
+            return array_sum(arr, threads);
+        }
+    }
+}
+
+template<random_access_iterator It>
+iter_value_t<It> fuzzy_sum(It first, It last, unsigned threads = 0) {
+    auto sums = utils::range_sum(first, last, threads);
+    return {sums.l, sums.m, sums.u};
+}
+
+template<random_access_iterator It>
+iter_value_t<It> fuzzy_mean(It first, It last, unsigned threads = 0) {
+    return utils::mean_of(utils::range_sum(first, last, threads), static_cast<size_t>(last - first));
+}
+
+template<random_access_iterator It>
+iter_value_t<It> fuzzy_min(It first, It last, unsigned threads = 0) {
+    return first[utils::parallel_extreme(first, static_cast<size_t>(last - first), threads,
+                                         [](const auto &a, const auto &b) { return a < b; })];
+}
+
+template<random_access_iterator It>
+iter_value_t<It> fuzzy_max(It first, It last, unsigned threads = 0) {
+    return first[utils::parallel_extreme(first, static_cast<size_t>(last - first), threads,
+                                         [](const auto &a, const auto &b) { return a > b; })];
+}
+
+template<floating_point T>
+BasicTriFuzzyNum<T> fuzzy_sum(const BasicTriFuzzyNumArray<T> &arr, unsigned threads = 0) {
+    auto sums = utils::array_sum(arr, threads);
+    return {sums.l, sums.m, sums.u};
+}
+
+template<floating_point T>
+BasicTriFuzzyNum<T> fuzzy_mean(const BasicTriFuzzyNumArray<T> &arr, unsigned threads = 0) {
+    return utils::mean_of(utils::array_sum(arr, threads), arr.size());
+}
+
+template<floating_point T, class Storage>
+BasicTriFuzzyNum<T> fuzzy_sum(const BasicTriFuzzyNumSet<T, Storage> &set, unsigned threads = 0) {
+    auto sums = utils::set_sum(set.begin(), set.end(), set.size(), threads);
+    return {sums.l, sums.m, sums.u};
+}
+
+// Sums the elements pairwise in blocks, instead of reading the compensated running sums of the set
+// like TriFuzzyNumSet::arithmetic_mean, so the result may differ from it in the last bits.
+template<floating_point T, class Storage>
+BasicTriFuzzyNum<T> fuzzy_mean(const BasicTriFuzzyNumSet<T, Storage> &set, unsigned threads = 0) {
+    return utils::mean_of(utils::set_sum(set.begin(), set.end(), set.size(), threads), set.size());
+}
+
+// The set is ordered by rank already.
+template<floating_point T, class Storage>
+BasicTriFuzzyNum<T> fuzzy_min(const BasicTriFuzzyNumSet<T, Storage> &set) {
+    if (set.size() == 0) throw length_error("fuzzy reduction - the range is empty.");
+    return *set.begin();
+}
+
+template<floating_point T, class Storage>
+BasicTriFuzzyNum<T> fuzzy_max(const BasicTriFuzzyNumSet<T, Storage> &set) {
+    if (set.size() == 0) throw length_error("fuzzy reduction - the range is empty.");
+    return *prev(set.end());
+}
+
+#endif // FUZZY_REDUCE_H
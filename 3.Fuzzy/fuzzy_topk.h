@@ -0,0 +1,178 @@
+#ifndef FUZZY_TOPK_H
+#define FUZZY_TOPK_H
+
+#include <algorithm>
+#include <tuple>
+#include <vector>
+#include "fuzzy.h"
+#include "fuzzy_array.h"
+
+// Selection of the k numbers of the largest (Largest = true) or the smallest rank
+// from a stream, in O(k) memory. Numbers whose rank is NaN are unordered even with
+// themselves, they are kept only when there are less than k other numbers.
+// Of the numbers of equal rank, the ones inserted first are kept.
+// Selectors filled by separate threads can be merged, the numbers of the merged selector
+// count as inserted after the numbers of this one, in their own order of insertion.
+template<floating_point T, bool Largest = true>
+class BasicTriFuzzyNumTopK {
+    public:
+        using value_type = BasicTriFuzzyNum<T>;
+
+        explicit BasicTriFuzzyNumTopK(size_t k);
+        size_t capacity() const;
+        size_t size() const;
+        bool empty() const;
+        void insert(const value_type &num);
+        template<input_iterator It>
+        void insert(It first, It last);
+        void insert(const BasicTriFuzzyNumArray<T> &arr);
+        void merge(const BasicTriFuzzyNumTopK &other);
+        void clear();
+        vector<value_type> sorted() const;
+    private:
+        using rank_t = tuple<T, T, T>;
+
+        // A kept number with its position in the order of insertion.
+        struct entry {
+            value_type num;
+            size_t seq;
+        };
+
+        size_t k;
+        size_t next_seq = 0;
+        // Heap with the worst of the kept numbers at the front, of the equal ones the latest inserted.
+        vector<entry> heap;
+
+        static bool ordered(const rank_t &rank);
+        static bool better(const value_type &a, const value_type &b);
+        static bool better(const rank_t &a, const rank_t &b);
+        static bool kept_before(const entry &a, const entry &b);
+        static rank_t rank_of(const value_type &num);
+        void push(const value_type &num);
+};
+
+template<floating_point T>
+using BasicTriFuzzyNumBottomK = BasicTriFuzzyNumTopK<T, false>;
+
+using TriFuzzyNumTopK = BasicTriFuzzyNumTopK<real_t, true>;
+using TriFuzzyNumBottomK = BasicTriFuzzyNumTopK<real_t, false>;
+
+template<floating_point T, bool Largest>
+BasicTriFuzzyNumTopK<T, Largest>::BasicTriFuzzyNumTopK(size_t k) : k(k) {
+    heap.reserve(k);
+}
+
+template<floating_point T, bool Largest>
+size_t BasicTriFuzzyNumTopK<T, Largest>::capacity() const { return k; }
+template<floating_point T, bool Largest>
+size_t BasicTriFuzzyNumTopK<T, Largest>::size() const { return heap.size(); }
+template<floating_point T, bool Largest>
+bool BasicTriFuzzyNumTopK<T, Largest>::empty() const { return heap.empty(); }
+template<floating_point T, bool Largest>
+void BasicTriFuzzyNumTopK<T, Largest>::clear() {
+    heap.clear();
+    next_seq = 0;
+}
+
+template<floating_point T, bool Largest>
+bool BasicTriFuzzyNumTopK<T, Largest>::ordered(const rank_t &rank) {
+    return is_eq(rank <=> rank);
+}
+
+// Whether a is strictly preferred to b.
+template<floating_point T, bool Largest>
+bool BasicTriFuzzyNumTopK<T, Largest>::better(const rank_t &a, const rank_t &b) {
+    if (!ordered(a)) return false;
+    if (!ordered(b)) return true;
+    return Largest ? a > b : a < b;
+}
+
+template<floating_point T, bool Largest>
+bool BasicTriFuzzyNumTopK<T, Largest>::better(const value_type &a, const value_type &b) {
+    if (!is_eq(a <=> a)) return false;
+    if (!is_eq(b <=> b)) return true;
+    return Largest ? a > b : a < b;
+}
+
+// Whether a is preferred to b, the earlier inserted of the numbers of equal rank.
+template<floating_point T, bool Largest>
+bool BasicTriFuzzyNumTopK<T, Largest>::kept_before(const entry &a, const entry &b) {
+    if (better(a.num, b.num)) return true;
+    if (better(b.num, a.num)) return false;
+    return a.seq < b.seq;
+}
+
+// The rank as computed by BasicTriFuzzyNum, for comparisons with the batches of ranks.
+template<floating_point T, bool Largest>
+typename BasicTriFuzzyNumTopK<T, Largest>::rank_t BasicTriFuzzyNumTopK<T, Largest>::rank_of(const value_type &num) {
+    T r1, r2, r3;
+    utils::rank_one(num.lower_value(), num.modal_value(), num.upper_value(), r1, r2, r3);
+    return {r1, r2, r3};
+}
+
+template<floating_point T, bool Largest>
+void BasicTriFuzzyNumTopK<T, Largest>::push(const value_type &num) {
+    if (heap.size() < k) {
+        heap.push_back({num, next_seq++});
+        push_heap(heap.begin(), heap.end(), kept_before);
+    }
+    else {
+        pop_heap(heap.begin(), heap.end(), kept_before);
+        heap.back() = {num, next_seq++};
+        push_heap(heap.begin(), heap.end(), kept_before);
+    }
+}
+
+template<floating_point T, bool Largest>
+void BasicTriFuzzyNumTopK<T, Largest>::insert(const value_type &num) {
+    if (heap.size() < k || (k > 0 && better(num, heap.front().num))) push(num);
+}
+
+template<floating_point T, bool Largest>
+template<input_iterator It>
+void BasicTriFuzzyNumTopK<T, Largest>::insert(It first, It last) {
+    for (; first != last; ++first) insert(*first);
+}
+
+// Ranks the array in blocks with the batch kernels, so that the numbers that do not
+// beat the worst kept one are rejected without constructing them.
+template<floating_point T, bool Largest>
+void BasicTriFuzzyNumTopK<T, Largest>::insert(const BasicTriFuzzyNumArray<T> &arr) {
+    constexpr size_t block = 1024;
+    vector<T> r1(block), r2(block), r3(block);
+    const T *l = arr.lower_values(), *m = arr.modal_values(), *u = arr.upper_values();
+
+    for (size_t first = 0; first < arr.size() && k > 0; first += block) {
+        size_t n = min(block, arr.size() - first);
+        utils::rank_n(l + first, m + first, u + first, r1.data(), r2.data(), r3.data(), n);
+
+        rank_t worst;
+        if (heap.size() == k) worst = rank_of(heap.front().num);
+        for (size_t i = 0; i < n; i++) {
+            if (heap.size() < k || better(rank_t(r1[i], r2[i], r3[i]), worst)) {
+                push(arr[first + i]);
+                if (heap.size() == k) worst = rank_of(heap.front().num);
+            }
+        }
+    }
+}
+
+template<floating_point T, bool Largest>
+void BasicTriFuzzyNumTopK<T, Largest>::merge(const BasicTriFuzzyNumTopK &other) {
+    vector<entry> entries(other.heap);
+    sort(entries.begin(), entries.end(), [](const entry &a, const entry &b) { return a.seq < b.seq; });
+    for (const auto &e : entries) insert(e.num);
+}
+
+// Returns the kept numbers, the best one first.
+template<floating_point T, bool Largest>
+vector<BasicTriFuzzyNum<T>> BasicTriFuzzyNumTopK<T, Largest>::sorted() const {
+    vector<entry> entries(heap);
+    sort_heap(entries.begin(), entries.end(), kept_before);
+    vector<value_type> res;
+    res.reserve(entries.size());
+    for (const auto &e : entries) res.push_back(e.num);
+    return res;
+}
+
+#endif // FUZZY_TOPK_H
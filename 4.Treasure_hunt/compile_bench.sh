@@ -0,0 +1,92 @@
+#!/usr/bin/env bash
+# Benchmark of the compile-time cost of the Treasure Hunt module (see treasure_hunt_bench.cc
+# for the runtime part).
+#
+# Usage: ./compile_bench.sh [sizes...]
+# For every size (default 100 1000 2500 5000 10000) generates an expedition() of that many
+# encounters of all of the participants, evaluated in a static_assert, and compiles it with
+# -fsyntax-only and with -O2. Reports the wall time and the peak memory of the compiler.
+# The compiler is taken from $CXX (default g++).
+#
+# The peak memory is measured with /usr/bin/time if it is installed, with getrusage() of
+# python3 otherwise, and not at all if neither of them is available.
+
+set -euo pipefail
+
+CXX=${CXX:-g++}
+dir=$(cd "$(dirname "$0")" && pwd)
+cxxflags=(-std=c++20 -fconstexpr-ops-limit=1000000000 -I"$dir")
+sizes=("$@")
+if [ ${#sizes[@]} -eq 0 ]; then sizes=(100 1000 2500 5000 10000); fi
+
+work=$(mktemp -d)
+trap 'rm -rf "$work"' EXIT
+
+# Writes the source of an expedition of $1 encounters to $2. The encounters cycle through
+# looting safe and trapped treasures by every participant and duels of every pair of them.
+generate() {
+    local n=$1 file=$2 i
+    {
+        echo '#include "treasure_hunt.h"'
+        echo 'constexpr long expeditionLoot() {'
+        echo '    Explorer<long> e;'
+        echo '    Adventurer<long, true> a(1u << 30);'
+        echo '    Veteran<long, 10> v;'
+        printf '    SafeTreasure<long> s[%d] = {' "$n"
+        for ((i = 0; i < n; i++)); do printf '%d,' $((i % 97 + 1)); done
+        echo '};'
+        printf '    TrappedTreasure<long> t[%d] = {' "$n"
+        for ((i = 0; i < n; i++)); do printf '%d,' $((i % 89 + 1)); done
+        echo '};'
+        echo '    expedition('
+        for ((i = 0; i < n; i++)); do
+            case $((i % 8)) in
+                0) printf '        Encounter{e, s[%d]}' "$i" ;;
+                1) printf '        Encounter{a, t[%d]}' "$i" ;;
+                2) printf '        Encounter{v, t[%d]}' "$i" ;;
+                3) printf '        Encounter{s[%d], a}' "$i" ;;
+                4) printf '        Encounter{e, a}' ;;
+                5) printf '        Encounter{v, s[%d]}' "$i" ;;
+                6) printf '        Encounter{a, v}' ;;
+                7) printf '        Encounter{v, e}' ;;
+            esac
+            if ((i + 1 < n)); then echo ','; else echo; fi
+        done
+        echo '    );'
+        echo '    return e.pay() + a.pay() + v.pay();'
+        echo '}'
+        echo 'static_assert(expeditionLoot() >= 0);'
+        echo 'int main() { return 0; }'
+    } > "$file"
+}
+
+# Runs the compiler with the given arguments and prints its wall time in ms and its peak
+# memory in MiB.
+measure() {
+    local start end mem=-
+    start=$(date +%s%N)
+    if [ -x /usr/bin/time ]; then
+        mem=$(/usr/bin/time -f '%M' -o "$work/rss" "$CXX" "$@" > /dev/null && cat "$work/rss")
+        mem=$((mem / 1024))
+    elif command -v python3 > /dev/null; then
+        mem=$(python3 -c '
+import resource, subprocess, sys
+subprocess.run(sys.argv[1:], check=True, stdout=subprocess.DEVNULL)
+print(resource.getrusage(resource.RUSAGE_CHILDREN).ru_maxrss // 1024)' "$CXX" "$@")
+    else
+        "$CXX" "$@" > /dev/null
+    fi
+    end=$(date +%s%N)
+    printf '%10d %10s' $(((end - start) / 1000000)) "$mem"
+}
+
+printf '%-14s %10s %10s %10s\n' "mode" "encounters" "ms" "MiB"
+for n in "${sizes[@]}"; do
+    generate "$n" "$work/expedition_$n.cc"
+    printf '%-14s %10d ' "-fsyntax-only" "$n"
+    measure "${cxxflags[@]}" -fsyntax-only "$work/expedition_$n.cc"
+    echo
+    printf '%-14s %10d ' "-O2" "$n"
+    measure "${cxxflags[@]}" -O2 -c "$work/expedition_$n.cc" -o "$work/expedition_$n.o"
+    echo
+done
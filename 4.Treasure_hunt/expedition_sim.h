@@ -0,0 +1,220 @@
+#ifndef EXPEDITION_SIM_H
+#define EXPEDITION_SIM_H
+
+#include <algorithm>
+#include <barrier>
+#include <cassert>
+#include <cstdint>
+#include <span>
+#include <thread>
+#include <vector>
+#include "treasure.h"
+#include "member.h"
+
+using namespace std;
+
+// Kind of an encounter, the same as the overloads of run() in treasure_hunt.h:
+// a participant looting a treasure or two participants fighting for their treasures.
+enum class EncounterKind : uint8_t { Loot, Duel };
+
+// Encounter of a simulated expedition. For Loot the first side is a participant and the
+// second one a treasure, for Duel both sides are participants.
+struct SimEncounter {
+    EncounterKind kind;
+    uint32_t first;
+    uint32_t second;
+};
+
+// Runtime counterpart of the participants, treasures and expedition() from treasure_hunt.h,
+// for participants and encounters known only at runtime. The state is kept in separate
+// arrays of the possessions, strengths and flags, and the rules of loot(), takeOverTreasures()
+// and run() are applied with selects instead of branches.
+template<LootType ValueType>
+class ExpeditionSimulator {
+    public:
+        using strength_t = uint32_t;
+        using id_t = uint32_t;
+
+        // Participants, as Explorer, Adventurer<ValueType, true> and Veteran.
+        id_t addExplorer() {
+            return addParticipant(false, false, 0);
+        }
+
+        id_t addAdventurer(strength_t strength) {
+            return addParticipant(true, false, strength);
+        }
+
+        id_t addVeteran(size_t completedExpeditions) {
+            assert(completedExpeditions < 25);
+            return addParticipant(true, true, fib(completedExpeditions));
+        }
+
+        id_t addTreasure(ValueType value, bool isTrapped) {
+            treasureValue.push_back(value);
+            trapped.push_back(isTrapped);
+            return static_cast<id_t>(treasureValue.size() - 1);
+        }
+
+        size_t participantCount() const { return possession.size(); }
+        size_t treasureCount() const { return treasureValue.size(); }
+
+        bool isArmed(id_t participant) const { return armed[participant]; }
+        bool isVeteran(id_t participant) const { return veteran[participant]; }
+        strength_t getStrength(id_t participant) const { return strength[participant]; }
+        ValueType getPossession(id_t participant) const { return possession[participant]; }
+        ValueType evaluate(id_t treasure) const { return treasureValue[treasure]; }
+
+        ValueType pay(id_t participant) {
+            ValueType res = possession[participant];
+            possession[participant] = 0;
+            return res;
+        }
+
+        void loot(id_t participant, id_t treasure) {
+            assert(participant < participantCount() && treasure < treasureCount());
+
+            bool isTrapped = trapped[treasure];
+            // Trapped treasures are taken only by armed participants of non-zero strength,
+            // and all of them but the veterans lose half of their strength.
+            bool takes = !isTrapped || (armed[participant] && strength[participant] > 0);
+            bool halves = isTrapped && takes && !veteran[participant];
+
+            ValueType value = treasureValue[treasure];
+            possession[participant] += takes ? value : 0;
+            treasureValue[treasure] = takes ? 0 : value;
+            strength[participant] >>= halves;
+        }
+
+        void duel(id_t first, id_t second) {
+            assert(first < participantCount() && second < participantCount());
+
+            // An armed participant beats an unarmed one, of two armed ones the stronger one
+            // wins, and nothing happens otherwise.
+            bool armedFirst = armed[first];
+            bool armedSecond = armed[second];
+            strength_t strengthFirst = strength[first];
+            strength_t strengthSecond = strength[second];
+            bool firstWins = armedFirst && (!armedSecond || strengthFirst > strengthSecond);
+            bool secondWins = armedSecond && (!armedFirst || strengthSecond > strengthFirst);
+
+            ValueType possessionFirst = possession[first];
+            ValueType possessionSecond = possession[second];
+            possession[first] = firstWins ? possessionFirst + possessionSecond : (secondWins ? 0 : possessionFirst);
+            possession[second] = secondWins ? possessionSecond + possessionFirst : (firstWins ? 0 : possessionSecond);
+        }
+
+        void run(const SimEncounter &e) {
+            if (e.kind == EncounterKind::Loot) loot(e.first, e.second);
+            else duel(e.first, e.second);
+        }
+
+        // Runs the encounters in order, as expedition() does.
+        void expedition(span<const SimEncounter> encounters) {
+            for (const auto &e : encounters) run(e);
+        }
+
+        // Runs the encounters on the given number of threads (0 for all of the hardware threads)
+        // with the same result as in order. Every encounter is assigned to the wave after the last
+        // wave touching any of its participants or its treasure, so the encounters of one wave are
+        // independent of each other. The waves run one after another, each one spread over the
+        // threads, and the runs of consecutive narrow waves are left to a single thread.
+        void expedition(span<const SimEncounter> encounters, unsigned threads) {
+            if (threads == 0) threads = max(1u, thread::hardware_concurrency());
+            if (threads == 1) {
+                expedition(encounters);
+                return;
+            }
+
+            auto order = scheduleWaves(encounters);
+            barrier sync(static_cast<ptrdiff_t>(threads));
+            auto work = [&](unsigned t) {
+                for (const auto &phase : order.phases) {
+                    if (phase.parallel) {
+                        size_t n = phase.last - phase.first;
+                        size_t from = phase.first + n * t / threads;
+                        size_t to = phase.first + n * (t + 1) / threads;
+                        for (size_t i = from; i < to; i++) run(encounters[order.encounters[i]]);
+                    }
+                    else if (t == 0) {
+                        for (size_t i = phase.first; i < phase.last; i++) run(encounters[order.encounters[i]]);
+                    }
+                    sync.arrive_and_wait();
+                }
+            };
+
+            vector<thread> workers;
+            for (unsigned t = 1; t < threads; t++) workers.emplace_back(work, t);
+            work(0);
+            for (auto &worker : workers) worker.join();
+        }
+
+    private:
+        // Waves narrower than this are not worth the synchronization of the threads.
+        static constexpr size_t minParallelWave = 2048;
+
+        // Range of the scheduled encounters, either of one wave or of consecutive narrow waves.
+        struct Phase {
+            size_t first;
+            size_t last;
+            bool parallel;
+        };
+
+        struct Schedule {
+            vector<uint32_t> encounters;
+            vector<Phase> phases;
+        };
+
+        vector<ValueType> possession;
+        vector<strength_t> strength;
+        vector<uint8_t> armed;
+        vector<uint8_t> veteran;
+        vector<ValueType> treasureValue;
+        vector<uint8_t> trapped;
+
+        id_t addParticipant(bool isArmed, bool isVeteran, strength_t participantStrength) {
+            possession.push_back(0);
+            strength.push_back(participantStrength);
+            armed.push_back(isArmed);
+            veteran.push_back(isVeteran);
+            return static_cast<id_t>(possession.size() - 1);
+        }
+
+        // Orders the encounters by wave (the waves are numbered from 1) and groups the waves into phases.
+        Schedule scheduleWaves(span<const SimEncounter> encounters) const {
+            // The last wave touching every participant and then every treasure.
+            vector<uint32_t> lastWave(participantCount() + treasureCount(), 0);
+            vector<uint32_t> wave(encounters.size());
+            uint32_t waves = 0;
+            for (size_t i = 0; i < encounters.size(); i++) {
+                const auto &e = encounters[i];
+                size_t a = e.first;
+                size_t b = e.kind == EncounterKind::Loot ? participantCount() + e.second : e.second;
+                wave[i] = max(lastWave[a], lastWave[b]) + 1;
+                lastWave[a] = lastWave[b] = wave[i];
+                waves = max(waves, wave[i]);
+            }
+
+            // Counting sort by wave.
+            vector<size_t> start(waves + 2, 0);
+            for (auto w : wave) start[w + 1]++;
+            for (size_t w = 1; w < start.size(); w++) start[w] += start[w - 1];
+
+            Schedule res;
+            res.encounters.resize(encounters.size());
+            vector<size_t> next(start.begin(), start.end() - 1);
+            for (size_t i = 0; i < encounters.size(); i++) res.encounters[next[wave[i]]++] = static_cast<uint32_t>(i);
+
+            for (uint32_t w = 1; w <= waves; w++) {
+                bool parallel = start[w + 1] - start[w] >= minParallelWave;
+                if (!parallel && !res.phases.empty() && !res.phases.back().parallel) {
+                    res.phases.back().last = start[w + 1];
+                }
+                else {
+                    res.phases.push_back({start[w], start[w + 1], parallel});
+                }
+            }
+            return res;
+        }
+};
+
+#endif // EXPEDITION_SIM_H
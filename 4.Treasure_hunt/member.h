@@ -1,8 +1,10 @@
 #ifndef MEMBER_H
 #define MEMBER_H
 
+#include <bit>
 #include <concepts>
 #include <cassert>
+#include <span>
 #include "treasure.h"
 
 using namespace std;
@@ -60,6 +62,23 @@ class ExpedtitionParticipant {
             }
         }
 
+        // loot() of every treasure in order, in closed form. An armed non-veteran halves
+        // the strength at every trapped treasure, so it takes the first bit_width(strength) ones.
+        template<bool IsTrapped, size_t Extent>
+        constexpr void lootAll(span<Treasure<ValueType, IsTrapped>, Extent> treasures) {
+            size_t count = treasures.size();
+            if (IsTrapped) {
+                if (!IsArmed || strength_ == 0) {
+                    count = 0;
+                }
+                else if (!IsVeteran) {
+                    count = min(count, static_cast<size_t>(bit_width(strength_)));
+                    strength_ = count < 32 ? strength_ >> count : 0;
+                }
+            }
+            possession += Treasure<ValueType, IsTrapped>::getLoot(treasures.first(count));
+        }
+
         constexpr ValueType pay() {
             ValueType res = possession;
             possession = 0;
@@ -3,6 +3,7 @@
 
 #include <concepts>
 #include <cstdint>
+#include <span>
 
 template<class T>
 concept LootType = std::integral<T>;
@@ -18,6 +19,27 @@ public:
         v = 0;
         return res;
     }
+    // getLoot() of all of the treasures. The values are summed in a fixed number of
+    // independent lanes, so that the compiler vectorizes the loop already at -O2.
+    constexpr static ValueType getLoot(std::span<Treasure> treasures) {
+        constexpr size_t lanes = 8;
+        ValueType partial[lanes] = {};
+        size_t i = 0;
+        for (; i + lanes <= treasures.size(); i += lanes) {
+            for (size_t j = 0; j < lanes; j++) {
+                partial[j] += treasures[i + j].v;
+                treasures[i + j].v = 0;
+            }
+        }
+
+        ValueType res = 0;
+        for (; i < treasures.size(); i++) {
+            res += treasures[i].v;
+            treasures[i].v = 0;
+        }
+        for (size_t j = 0; j < lanes; j++) res += partial[j];
+        return res;
+    }
 private:
     ValueType v;
 };
@@ -71,17 +71,22 @@ constexpr void run(Encounter<P1, P2> e) requires (P1::isArmed && P2::isArmed) {
     }
 }
 
-void expedition() {}
-
-template<class Arg>
-constexpr void expedition(Arg arg) {
-    run (arg);
-}
+template<class E>
+struct EncounterRunner {
+    static constexpr int apply(E e) {
+        run(e);
+        return 0;
+    }
+};
 
-template<class Head, class... Tail>
-constexpr void expedition(Head head, Tail... tail) {
-    expedition(head);
-    expedition(tail...);
+// Runs the encounters in order (the initializers of a braced list are evaluated in order).
+// One pack expansion instead of one instantiation per encounter. The calls go through
+// EncounterRunner, as GCC resolves the calls of a function template in a long expansion
+// (or a fold) in superlinear time, and a static member function of a class template
+// in linear time.
+template<class... Encounters>
+constexpr void expedition(Encounters... encounters) {
+    [[maybe_unused]] int order[] = {0, EncounterRunner<Encounters>::apply(encounters)...};
 }
 
 #endif // TREASURE_HUNT_H
@@ -0,0 +1,218 @@
+// Benchmark of the Treasure Hunt module (runtime part, see compile_bench.sh for the
+// compile-time part).
+//
+// Build:
+//   g++ -std=c++20 -O2 -pthread treasure_hunt_bench.cc -o treasure_hunt_bench
+//
+// Usage: ./treasure_hunt_bench [scale]
+// The scale (default 1) multiplies the number of operations of every workload.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include "treasure_hunt.h"
+#include "expedition_sim.h"
+
+using namespace std;
+
+namespace {
+    using bench_clock = chrono::steady_clock;
+    using value_t = int64_t;
+
+    // Keeps the compiler from optimizing the measured computation away.
+    template<class T>
+    void keep(T &value) {
+        asm volatile("" : : "r"(&value) : "memory");
+    }
+
+    template<class F>
+    double time_ns(F &&f) {
+        auto before = bench_clock::now();
+        f();
+        auto after = bench_clock::now();
+        return chrono::duration<double, nano>(after - before).count();
+    }
+
+    void report(const char *name, size_t ops, double ns) {
+        printf("%-34s %12zu %10.2f %14.0f\n", name, ops, ns / ops, ops / ns * 1e9);
+    }
+
+    // Runs f(), which performs ops operations, and prints the cost of one operation.
+    template<class F>
+    void measure(const char *name, size_t ops, F &&f) {
+        report(name, ops, time_ns(f));
+    }
+
+    mt19937_64 rng(2022);
+
+    // Non-zero values, so that the looted treasures are the ones left with zero.
+    vector<value_t> random_values(size_t count) {
+        vector<value_t> res(count);
+        for (auto &v : res) v = static_cast<value_t>(rng() % 1000 + 1);
+        return res;
+    }
+
+    // Strength known only at runtime.
+    uint32_t random_strength() {
+        return static_cast<uint32_t>(rng() % 1000000 + 1);
+    }
+
+    using explorer_t = Explorer<value_t>;
+    using adventurer_t = Adventurer<value_t, true>;
+    using veteran_t = Veteran<value_t, 20>;
+
+    template<class P, bool IsTrapped>
+    void loot(const char *name, P participant, const vector<value_t> &values) {
+        measure(name, values.size(), [&] {
+            for (auto v : values) {
+                participant.loot(Treasure<value_t, IsTrapped>(v));
+                keep(participant);
+            }
+        });
+    }
+
+    // The treasures are split evenly between the participants, every one of them calls lootAll()
+    // on its part. Only the treasures actually looted count as operations.
+    template<class P, bool IsTrapped>
+    void loot_all(const char *name, vector<P> participants, const vector<value_t> &values) {
+        vector<Treasure<value_t, IsTrapped>> treasures(values.begin(), values.end());
+        size_t part = treasures.size() / participants.size();
+        double ns = time_ns([&] {
+            for (size_t i = 0; i < participants.size(); i++) {
+                participants[i].lootAll(span(treasures).subspan(i * part, part));
+                keep(participants[i]);
+            }
+        });
+
+        size_t looted = 0;
+        for (auto &treasure : treasures) looted += treasure.evaluate() == 0;
+        report(name, looted, ns);
+    }
+
+    template<class P1, class P2>
+    void duel(const char *name, P1 first, P2 second, size_t ops) {
+        measure(name, ops, [&] {
+            for (size_t i = 0; i < ops; i++) {
+                run(Encounter{first, second});
+                keep(first);
+                keep(second);
+            }
+        });
+    }
+
+    void participants(size_t scale) {
+        const size_t ops = 10000000 * scale;
+        auto values = random_values(ops);
+
+        loot<explorer_t, false>("loot safe/Explorer", explorer_t(), values);
+        loot<adventurer_t, false>("loot safe/Adventurer", adventurer_t(random_strength()), values);
+        loot<veteran_t, false>("loot safe/Veteran", veteran_t(), values);
+        loot<explorer_t, true>("loot trapped/Explorer", explorer_t(), values);
+        // The strength of an adventurer drops to zero after a few trapped treasures.
+        loot<adventurer_t, true>("loot trapped/Adventurer", adventurer_t(random_strength()), values);
+        loot<veteran_t, true>("loot trapped/Veteran", veteran_t(), values);
+
+        // The closed form stops at the first trapped treasure that an adventurer cannot take,
+        // after about 20 of them, so the adventurers get 64 treasures each.
+        vector<adventurer_t> adventurers;
+        for (size_t i = 0; i < ops / 64; i++) adventurers.emplace_back(random_strength());
+        loot_all<explorer_t, false>("lootAll safe/Explorer", {explorer_t()}, values);
+        loot_all<adventurer_t, true>("lootAll trapped/Adventurer", adventurers, values);
+        loot_all<veteran_t, true>("lootAll trapped/Veteran", {veteran_t()}, values);
+
+        duel("duel/Explorer-Explorer", explorer_t(), explorer_t(), ops);
+        duel("duel/Explorer-Adventurer", explorer_t(), adventurer_t(random_strength()), ops);
+        duel("duel/Adventurer-Adventurer", adventurer_t(random_strength()), adventurer_t(random_strength()), ops);
+        duel("duel/Adventurer-Veteran", adventurer_t(random_strength()), veteran_t(), ops);
+        duel("duel/Veteran-Explorer", veteran_t(), explorer_t(), ops);
+    }
+
+    // expedition() of eight encounters of all of the kinds, repeated.
+    void expeditions(size_t scale) {
+        const size_t reps = 1000000 * scale;
+        auto values = random_values(8);
+        explorer_t explorer;
+        adventurer_t adventurer(random_strength());
+        veteran_t veteran;
+
+        measure("expedition/8 encounters", reps * 8, [&] {
+            for (size_t i = 0; i < reps; i++) {
+                SafeTreasure<value_t> s1(values[0]), s2(values[1]), s3(values[2]);
+                TrappedTreasure<value_t> t1(values[3]), t2(values[4]);
+                expedition(Encounter{explorer, s1}, Encounter{adventurer, t1}, Encounter{veteran, t2},
+                           Encounter{s2, adventurer}, Encounter{explorer, adventurer}, Encounter{veteran, s3},
+                           Encounter{adventurer, veteran}, Encounter{veteran, explorer});
+                keep(explorer);
+                keep(adventurer);
+                keep(veteran);
+            }
+        });
+    }
+
+    // Whether the two simulators end with the same participants and treasures.
+    bool same_state(const ExpeditionSimulator<value_t> &a, const ExpeditionSimulator<value_t> &b) {
+        if (a.participantCount() != b.participantCount() || a.treasureCount() != b.treasureCount())
+            return false;
+        for (uint32_t i = 0; i < a.participantCount(); i++) {
+            if (a.getPossession(i) != b.getPossession(i) || a.getStrength(i) != b.getStrength(i))
+                return false;
+        }
+        for (uint32_t i = 0; i < a.treasureCount(); i++) {
+            if (a.evaluate(i) != b.evaluate(i))
+                return false;
+        }
+        return true;
+    }
+
+    // The same rules on participants and encounters chosen at runtime.
+    void simulator(size_t scale) {
+        const size_t participants = 100000;
+        const size_t treasures = 1000000;
+        const size_t encounters = 10000000 * scale;
+
+        ExpeditionSimulator<value_t> sim;
+        for (size_t i = 0; i < participants; i++) {
+            switch (rng() % 3) {
+                case 0: sim.addExplorer(); break;
+                case 1: sim.addAdventurer(random_strength()); break;
+                default: sim.addVeteran(rng() % 25); break;
+            }
+        }
+        for (size_t i = 0; i < treasures; i++) sim.addTreasure(static_cast<value_t>(rng() % 1000), rng() % 2);
+
+        vector<SimEncounter> list(encounters);
+        for (auto &e : list) {
+            bool duel = rng() % 4 == 0;
+            e.kind = duel ? EncounterKind::Duel : EncounterKind::Loot;
+            e.first = static_cast<uint32_t>(rng() % participants);
+            e.second = static_cast<uint32_t>(rng() % (duel ? participants : treasures));
+        }
+
+        // Both runs start from the same state and have to end in the same state, otherwise the
+        // threaded run is wrong and its time means nothing.
+        ExpeditionSimulator<value_t> threaded = sim;
+        double sequential_ns = time_ns([&] { sim.expedition(list); });
+        double threaded_ns = time_ns([&] { threaded.expedition(list, 0); });
+        if (!same_state(sim, threaded)) {
+            fprintf(stderr, "simulator/expedition: the threaded run ended in a different state\n");
+            exit(EXIT_FAILURE);
+        }
+        report("simulator/expedition", encounters, sequential_ns);
+        report("simulator/expedition (threads)", encounters, threaded_ns);
+    }
+}
+
+int main(int argc, char *argv[]) {
+    size_t scale = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1;
+    if (scale == 0) scale = 1;
+
+    printf("%-34s %12s %10s %14s\n", "workload", "ops", "ns/op", "ops/s");
+
+    participants(scale);
+    expeditions(scale);
+    simulator(scale);
+
+    return 0;
+}
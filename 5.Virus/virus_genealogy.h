@@ -1,13 +1,22 @@
 #ifndef VIRUS_GENEALOGY_H
 #define VIRUS_GENEALOGY_H
 
+#include <algorithm>
+#include <atomic>
 #include <map>
 #include <set>
 #include <vector>
 #include <memory>
+#include <mutex>
 #include <iostream>
 #include <iterator>
+#include <limits>
 #include <iostream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include "virus_index.h"
 
 class VirusNotFound : public std::runtime_error {
 public:
@@ -24,6 +33,40 @@ public:
     TriedToRemoveStemVirus() : std::logic_error("TriedToRemoveStemVirus") {};
 };
 
+// Reads the records for create_bulk(), one per line, as the id of a virus followed by the ids of its parents,
+// separated with whitespace. Throws std::invalid_argument on a malformed line.
+template<typename Id>
+std::vector<std::pair<Id, std::vector<Id>>> read_virus_records(std::istream &input) {
+    std::vector<std::pair<Id, std::vector<Id>>> records;
+    std::string line;
+
+    while (std::getline(input, line)) {
+        std::istringstream fields(line);
+        std::pair<Id, std::vector<Id>> record;
+        if (!(fields >> record.first)) {
+            if (fields.eof())
+                continue;
+            throw std::invalid_argument("read_virus_records");
+        }
+
+        Id parent;
+        while (fields >> parent)
+            record.second.push_back(parent);
+        if (!fields.eof())
+            throw std::invalid_argument("read_virus_records");
+
+        records.push_back(std::move(record));
+    }
+
+    return records;
+}
+
+template<typename Virus>
+class VirusGenealogySnapshot;
+
+template<typename Virus>
+class VirusGenealogyImage;
+
 template<typename Virus>
 class VirusGenealogy {
 private:
@@ -34,6 +77,13 @@ private:
 
         std::shared_ptr<Virus> virus;
         set_t parents, children;
+        // Labels of the reachability index, valid if version is the index_version of the genealogy: the ones
+        // of the DFS visiting the children in order, and the ones of the DFS visiting them in reverse order.
+        std::size_t pre = 0, post = 0, low = 0, version = 0;
+        std::size_t post_reverse = 0, low_reverse = 0, version_reverse = 0;
+        // Equal to version if the path of the DFS tree from the stem virus may have lost a removed virus,
+        // so that pre and post no longer prove that the node is reachable from its ancestors in the tree.
+        std::size_t detached = 0;
 
         Node(id_type id) {
             virus = std::make_shared<Virus>(id);
@@ -41,11 +91,24 @@ private:
     };
 
     using node_ptr = std::shared_ptr<Node>;
-    using map_t = std::map<id_type, node_ptr>;
+    using map_t = virus_index_t<id_type, node_ptr>;
 
     id_type stem_id;
     map_t viruses;
 
+    // Reachability index, built by build_index() on the first query after it is invalidated. The viruses
+    // created after it was built are not labelled, and neither are any of their descendants, so it is rebuilt
+    // once they are over an eighth of all of the viruses. The queries are const, so concurrent ones build
+    // it under index_mutex; index_valid is set only once it is built.
+    mutable std::size_t index_version = 0;
+    mutable std::atomic<bool> index_valid = false;
+    mutable std::mutex index_mutex;
+    // Number of the viruses created unlabelled since the index was built, changed only by the writers.
+    std::size_t unlabelled = 0;
+
+    friend class VirusGenealogySnapshot<Virus>;
+    friend class VirusGenealogyImage<Virus>;
+
     class ChildrenIterator {
     private:
         typename std::set<node_ptr>::const_iterator it;
@@ -126,29 +189,217 @@ private:
 
     using to_erase_t = std::vector<std::pair<typename Node::set_t *, typename Node::set_t::iterator>>;
 
-    void remove_rec(id_type const &id, node_ptr &parent, map_t &viruses_copy,
-                    to_erase_t &to_erase, std::map<node_ptr, int> &parents_count) {
+    using removed_t = std::vector<typename map_t::iterator>;
+
+    // Schedules the erasure of the edges from the virus at the given index of removed to its children,
+    // and the removal of the children left without parents. Only finds the iterators, nothing is changed yet.
+    void collect_removed(std::size_t index, removed_t &removed, to_erase_t &to_erase,
+                         std::map<node_ptr, int> &parents_count) {
+        const node_ptr &curr_node = removed[index]->second;
+
+        for (auto &child : curr_node->children) {
+            to_erase.emplace_back(&child->parents, child->parents.find(curr_node));
+
+            auto count = parents_count.emplace(child, child->parents.size()).first;
+            if (--count->second == 0) {
+                removed.push_back(viruses.find(child->virus->get_id()));
+
+                for (auto &par : child->parents)
+                    to_erase.emplace_back(&par->children, par->children.find(child));
+            }
+        }
+    }
+
+    bool labelled(const Node &node) const noexcept {
+        return node.version == index_version;
+    }
 
-        auto pair_iter = viruses_copy.find(id);
-        node_ptr curr_node = pair_iter->second;
-        to_erase.emplace_back(&curr_node->parents, curr_node->parents.find(parent));
+    bool detached(const Node &node) const noexcept {
+        return node.detached == index_version;
+    }
 
-        if (parents_count.contains(curr_node))
-            parents_count[curr_node]--;
-        else
-            parents_count[curr_node] = curr_node->parents.size() - 1;
+    void invalidate_index() noexcept {
+        index_valid.store(false, std::memory_order_relaxed);
+        unlabelled = 0;
+    }
+
+    // Counts the viruses created unlabelled. The queries about them walk up through their unlabelled
+    // ancestors, so once those are over an eighth of all of the viruses, the next query rebuilds the index,
+    // which costs O(viruses + edges) per that many creations.
+    void count_unlabelled(std::size_t created) noexcept {
+        if (!index_valid.load(std::memory_order_relaxed))
+            return;
+        unlabelled += created;
+        if (unlabelled > viruses.size() / 8)
+            invalidate_index();
+    }
 
-        if (parents_count[curr_node] == 0) {
-            viruses_copy.erase(pair_iter);
+    // Marks the labelled viruses reachable from the given ones as detached, skipping the ones marked before,
+    // so that all of the marking between two builds of the index visits every virus and edge at most once.
+    // Called before a removal with the children of the removed viruses which remain: every virus whose path
+    // of the DFS tree goes through a removed one is reachable from such a child, and no removed one is.
+    void detach_reachable(std::vector<Node *> stack) {
+        while (!stack.empty()) {
+            Node *node = stack.back();
+            stack.pop_back();
+            if (!labelled(*node) || detached(*node))
+                continue;
+            node->detached = index_version;
+            for (auto &child : node->children)
+                stack.push_back(child.get());
+        }
+    }
 
-            for (auto &par : curr_node->parents)
-                to_erase.emplace_back(&par->children, par->children.find(curr_node));
+    // Labels the viruses with a DFS from the stem virus: pre and post are the preorder and postorder numbers,
+    // so that the descendants of a node in the DFS tree have their pre and post within its [pre, post], and low
+    // is the lowest post of the descendants of a node, so that all of them have their post within its [low, post].
+    // The reverse DFS gives only the second, independent [low, post] intervals.
+    template<bool Reverse>
+    void label_dfs(std::size_t version) const {
+        using iterator = std::conditional_t<Reverse, typename Node::set_t::const_reverse_iterator,
+                                            typename Node::set_t::const_iterator>;
+        constexpr auto post_of = Reverse ? &Node::post_reverse : &Node::post;
+        constexpr auto low_of = Reverse ? &Node::low_reverse : &Node::low;
+        constexpr auto version_of = Reverse ? &Node::version_reverse : &Node::version;
+
+        std::size_t pre = 0, post = 0;
+        std::vector<std::pair<Node *, iterator>> stack;
+
+        auto visit = [&](Node *node) {
+            node->*version_of = version;
+            if constexpr (!Reverse)
+                node->pre = pre++;
+            node->*low_of = std::numeric_limits<std::size_t>::max();
+            if constexpr (Reverse)
+                stack.emplace_back(node, node->children.rbegin());
+            else
+                stack.emplace_back(node, node->children.begin());
+        };
+        auto last = [](Node *node) {
+            if constexpr (Reverse)
+                return node->children.rend();
+            else
+                return node->children.end();
+        };
 
-            for (auto &child : curr_node->children)
-                remove_rec(child->virus->get_id(), curr_node, viruses_copy, to_erase, parents_count);
+        visit(viruses.find(stem_id)->second.get());
+        while (!stack.empty()) {
+            auto &[node, it] = stack.back();
+            if (it != last(node)) {
+                Node *child = (it++)->get();
+                if (child->*version_of != version)
+                    visit(child);
+                else
+                    node->*low_of = std::min(node->*low_of, child->*low_of);
+                continue;
+            }
+
+            node->*post_of = post++;
+            node->*low_of = std::min(node->*low_of, node->*post_of);
+            Node *finished = node;
+            stack.pop_back();
+            if (!stack.empty())
+                stack.back().first->*low_of = std::min(stack.back().first->*low_of, finished->*low_of);
         }
     }
 
+    void build_index() const {
+        std::lock_guard lock(index_mutex);
+        if (index_valid.load(std::memory_order_relaxed))
+            return;
+
+        std::size_t version = index_version + 1;
+        label_dfs<false>(version);
+        label_dfs<true>(version);
+        index_version = version;
+        index_valid.store(true, std::memory_order_release);
+    }
+
+    // Whether x is a descendant of a or a itself, for labelled a and x. The removals since the index was built
+    // only take paths away, so the [low, post] intervals still rule out the nodes not reaching x, but the DFS
+    // tree intervals prove a path only if x is not detached.
+    bool reaches_labelled(const Node *a, const Node *x) const {
+        auto may_reach = [x](const Node *node) {
+            return node->low <= x->low && x->post <= node->post
+                && node->low_reverse <= x->low_reverse && x->post_reverse <= node->post_reverse;
+        };
+        bool tree_valid = !detached(*x);
+        auto tree_reaches = [x, tree_valid](const Node *node) {
+            return node == x || (tree_valid && node->pre <= x->pre && x->post <= node->post);
+        };
+
+        if (!may_reach(a))
+            return false;
+        if (tree_reaches(a))
+            return true;
+
+        // A DFS from a, pruned to the nodes whose labels contain the labels of x.
+        std::vector<const Node *> stack{a};
+        std::set<const Node *> visited{a};
+        while (!stack.empty()) {
+            const Node *node = stack.back();
+            stack.pop_back();
+            for (auto &child : node->children) {
+                if (!labelled(*child) || !may_reach(child.get()) || !visited.insert(child.get()).second)
+                    continue;
+                if (tree_reaches(child.get()))
+                    return true;
+                stack.push_back(child.get());
+            }
+        }
+
+        return false;
+    }
+
+    // Whether x is a descendant of a or a itself.
+    bool reaches(const Node *a, const Node *x) const {
+        if (a == x)
+            return true;
+        if (labelled(*x))
+            return labelled(*a) && reaches_labelled(a, x);
+
+        // The ancestors of an unlabelled x are found through its unlabelled ancestors.
+        std::vector<const Node *> stack{x};
+        std::set<const Node *> visited{x};
+        while (!stack.empty()) {
+            const Node *node = stack.back();
+            stack.pop_back();
+            for (auto &parent : node->parents) {
+                if (parent.get() == a)
+                    return true;
+                if (labelled(*parent)) {
+                    if (labelled(*a) && reaches_labelled(a, parent.get()))
+                        return true;
+                }
+                else if (visited.insert(parent.get()).second) {
+                    stack.push_back(parent.get());
+                }
+            }
+        }
+
+        return false;
+    }
+
+    // The ids of the viruses reachable from the given one through the given sets, without it.
+    std::vector<id_type> collect_reachable(const node_ptr &start, typename Node::set_t Node::*next) const {
+        std::vector<const Node *> stack{start.get()};
+        std::set<const Node *> visited{start.get()};
+        std::vector<id_type> res;
+
+        while (!stack.empty()) {
+            const Node *node = stack.back();
+            stack.pop_back();
+            for (auto &other : node->*next) {
+                if (visited.insert(other.get()).second) {
+                    stack.push_back(other.get());
+                    res.push_back(other->virus->get_id());
+                }
+            }
+        }
+
+        return res;
+    }
+
     const node_ptr& get_node_ptr(id_type const &id) const {
         auto it = viruses.find(id);
 
@@ -160,6 +411,8 @@ private:
 
 public:
     using children_iterator = ChildrenIterator;
+    // A virus and its parents, as taken by create().
+    using record_type = std::pair<id_type, std::vector<id_type>>;
 
     VirusGenealogy(id_type const &stem_id) : stem_id(stem_id) {
         node_ptr node = std::make_shared<Node>(stem_id);
@@ -226,6 +479,7 @@ public:
         viruses.emplace(id, new_node_ptr).first;
 
         guard.dropRollback();
+        count_unlabelled(1);
     }
 
     void create(id_type const &id, std::vector<id_type> const &parent_ids) {
@@ -255,6 +509,106 @@ public:
         for (auto &guard: insert_guards) {
             guard->dropRollback();
         }
+        count_unlabelled(1);
+    }
+
+    // Has the same effect as create(id, parent_ids) called for all of the records in order, but all or nothing.
+    // The records are validated first, so that nothing is changed if any of them would throw. Only then the new
+    // viruses are added to the sets of the children of their parents, in order, and to the map, with a rollback
+    // on failure.
+    void create_bulk(std::vector<record_type> const &records) {
+        map_t created;
+        reserve_index(created, records.size());
+
+        auto find_parent = [&](id_type const &id) -> const node_ptr * {
+            auto it = viruses.find(id);
+            if (it != viruses.end())
+                return &it->second;
+            auto created_it = created.find(id);
+            return created_it != created.end() ? &created_it->second : nullptr;
+        };
+
+        // The new viruses with their parents, and all of the edges to them, which are added to the sets
+        // of the children only after all of the records are validated.
+        std::vector<node_ptr> new_nodes;
+        std::vector<std::pair<Node *, const node_ptr *>> edges;
+        new_nodes.reserve(records.size());
+        auto unlink_new_nodes = [&]() noexcept {
+            for (auto &node : new_nodes) {
+                node->parents.clear();
+                node->children.clear();
+            }
+        };
+
+        try {
+            std::vector<const node_ptr *> parents;
+            for (auto &[id, parent_ids] : records) {
+                if (viruses.contains(id) || created.contains(id))
+                    throw VirusAlreadyCreated();
+
+                parents.clear();
+                for (auto &parent : parent_ids) {
+                    parents.push_back(find_parent(parent));
+                    if (!parents.back())
+                        throw VirusNotFound();
+                }
+
+                if (parents.empty())
+                    continue;
+
+                node_ptr &new_node_ptr = new_nodes.emplace_back(std::make_shared<Node>(id));
+                created.emplace(id, new_node_ptr);
+
+                // In the order of the set, so that every insertion is at its end.
+                std::sort(parents.begin(), parents.end(), [](auto a, auto b) { return *a < *b; });
+                for (auto parent_ptr : parents) {
+                    if (!new_node_ptr->parents.empty() && *new_node_ptr->parents.rbegin() == *parent_ptr)
+                        continue;
+                    new_node_ptr->parents.emplace_hint(new_node_ptr->parents.end(), *parent_ptr);
+                    edges.emplace_back(parent_ptr->get(), &new_node_ptr);
+                }
+            }
+        }
+        catch (...) {
+            unlink_new_nodes();
+            throw;
+        }
+
+        // Grouped by the parent and in the order of the sets of the children.
+        std::sort(edges.begin(), edges.end(), [](auto const &a, auto const &b) {
+            return a.first != b.first ? a.first < b.first : *a.second < *b.second;
+        });
+
+        to_erase_t linked;
+        std::vector<typename map_t::iterator> inserted;
+        try {
+            linked.reserve(edges.size());
+            inserted.reserve(new_nodes.size());
+            reserve_index(viruses, viruses.size() + new_nodes.size());
+
+            for (auto &[parent, child] : edges) {
+                auto it = parent->children.emplace_hint(parent->children.end(), *child);
+                linked.emplace_back(&parent->children, it);
+            }
+
+            for (auto &node : new_nodes)
+                inserted.push_back(viruses.emplace(node->virus->get_id(), node).first);
+        }
+        catch (...) {
+            for (auto &entry : inserted)
+                viruses.erase(entry);
+            for (auto &erase_pair : linked)
+                erase_pair.first->erase(erase_pair.second);
+            unlink_new_nodes();
+            throw;
+        }
+
+        count_unlabelled(new_nodes.size());
+    }
+
+    // Creates the viruses read with read_virus_records().
+    void create_bulk(std::istream &input) {
+        create_bulk(read_virus_records<id_type>(input));
     }
 
     void connect(id_type const &child_id, id_type const &parent_id) {
@@ -267,6 +621,32 @@ public:
         child->parents.emplace(parent);
 
         guard.dropRollback();
+        // An unlabelled child and its descendants only gain labelled ancestors.
+        if (labelled(*child))
+            invalidate_index();
+    }
+
+    // Whether the virus is a descendant of the other one, not counting itself.
+    bool is_descendant(id_type const &id, id_type const &ancestor_id) const {
+        const node_ptr &node = get_node_ptr(id);
+        const node_ptr &ancestor = get_node_ptr(ancestor_id);
+
+        if (node == ancestor)
+            return false;
+        if (!index_valid.load(std::memory_order_acquire))
+            build_index();
+
+        return reaches(ancestor.get(), node.get());
+    }
+
+    // Returns the ids of all of the ancestors of the virus, in no particular order.
+    std::vector<id_type> get_ancestors(id_type const &id) const {
+        return collect_reachable(get_node_ptr(id), &Node::parents);
+    }
+
+    // Returns the ids of all of the descendants of the virus, in no particular order.
+    std::vector<id_type> get_descendants(id_type const &id) const {
+        return collect_reachable(get_node_ptr(id), &Node::children);
     }
 
     void remove(id_type const &id) {
@@ -275,24 +655,34 @@ public:
         if (id == stem_id)
             throw TriedToRemoveStemVirus();
 
-        map_t viruses_copy(viruses);
+        removed_t removed{viruses.find(id)};
         to_erase_t to_erase;
         std::map<node_ptr, int> parents_count;
 
-        auto pair_iter = viruses_copy.find(id);
-        node_ptr curr_node = pair_iter->second;
-        viruses_copy.erase(pair_iter);
-
+        const node_ptr &curr_node = removed.front()->second;
         for (auto &par : curr_node->parents)
             to_erase.emplace_back(&par->children, par->children.find(curr_node));
 
-        for (auto &child : curr_node->children)
-            remove_rec(child->virus->get_id(), curr_node, viruses_copy, to_erase, parents_count);
+        for (std::size_t i = 0; i < removed.size(); i++)
+            collect_removed(i, removed, to_erase, parents_count);
+
+        // The index stays valid for the remaining viruses, only the ones below the removed part lose the
+        // positive answers of the DFS tree. Marked before anything is erased, so that a bad_alloc leaves
+        // the genealogy unchanged, with at most a few viruses detached needlessly, which only costs time.
+        if (index_valid.load(std::memory_order_relaxed)) {
+            std::vector<Node *> remaining;
+            for (auto &[child, count] : parents_count)
+                if (count > 0)
+                    remaining.push_back(child.get());
+            detach_reachable(std::move(remaining));
+        }
 
+        // Nothing below throws. The removed nodes are kept alive by the map until all of the edges are erased.
         for (auto &erase_pair: to_erase)
             erase_pair.first->erase(erase_pair.second);
 
-        viruses.swap(viruses_copy);
+        for (auto &entry: removed)
+            viruses.erase(entry);
     }
 };
 
@@ -0,0 +1,431 @@
+#ifndef VIRUS_GENEALOGY_ARENA_H
+#define VIRUS_GENEALOGY_ARENA_H
+
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "virus_genealogy.h"
+
+// VirusGenealogy with the nodes kept in an arena and addressed by 32-bit handles.
+// The viruses live inside the slots of the arena, the parents and the children of a node
+// are sorted vectors of handles, and the slots of the removed viruses are reused.
+// The interface and the exception guarantees are the same as of VirusGenealogy, except
+// that children iterators are invalidated by any change of the list of the children.
+template<typename Virus>
+class ArenaVirusGenealogy {
+private:
+    using id_type = typename Virus::id_type;
+    using handle_t = std::uint32_t;
+    using adjacency_t = std::vector<handle_t>;
+
+    struct Slot {
+        std::optional<Virus> virus;
+        adjacency_t parents, children;
+
+        Slot(id_type const &id) : virus(std::in_place, id) {}
+    };
+
+    using arena_t = std::deque<Slot>;
+    using map_t = virus_index_t<id_type, handle_t>;
+
+    id_type stem_id;
+    arena_t slots;
+    std::vector<handle_t> free_slots;
+    map_t viruses;
+
+    class ChildrenIterator {
+    private:
+        const arena_t *slots = nullptr;
+        typename adjacency_t::const_iterator it;
+
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = Virus;
+        using pointer = const value_type *;
+        using reference = const value_type &;
+
+        ChildrenIterator() = default;
+        ChildrenIterator(const arena_t *slots, typename adjacency_t::const_iterator iter) : slots(slots), it(iter) {}
+
+        reference operator*() const {
+            return *(*slots)[*it].virus;
+        }
+
+        pointer operator->() const {
+            return &*(*slots)[*it].virus;
+        }
+
+        ChildrenIterator &operator++() {
+            it++;
+            return *this;
+        }
+
+        ChildrenIterator operator++(int) {
+            ChildrenIterator result(*this);
+            operator++();
+            return result;
+        }
+
+        ChildrenIterator &operator--() {
+            it--;
+            return *this;
+        }
+
+        ChildrenIterator operator--(int) {
+            ChildrenIterator result(*this);
+            operator--();
+            return result;
+        }
+
+        bool operator==(const ChildrenIterator &other) const { return it == other.it; };
+        bool operator!=(const ChildrenIterator &other) const { return it != other.it; };
+    };
+
+    // Slot taken for a new virus, given back to the arena unless dropRollback() is called.
+    class SlotGuard {
+    public:
+        SlotGuard(ArenaVirusGenealogy *genealogy, id_type const &id) : genealogy(genealogy), rollback(false) {
+            handle = genealogy->acquire(id);
+            rollback = true;
+        }
+        SlotGuard(SlotGuard const &) = delete;
+        SlotGuard & operator=(SlotGuard const &) = delete;
+
+        ~SlotGuard() noexcept {
+            if (rollback)
+                genealogy->release(handle);
+        }
+
+        handle_t get() const noexcept {
+            return handle;
+        }
+
+        void dropRollback() noexcept {
+            rollback = false;
+        }
+
+    private:
+        ArenaVirusGenealogy *genealogy;
+        handle_t handle;
+        bool rollback;
+    };
+
+    // Makes room for one more element, so that the following insertion does not throw.
+    static void reserve_one(adjacency_t &adjacency) {
+        if (adjacency.size() == adjacency.capacity())
+            adjacency.reserve(std::max<std::size_t>(4, 2 * adjacency.capacity()));
+    }
+
+    static bool contains(adjacency_t const &adjacency, handle_t handle) noexcept {
+        return std::binary_search(adjacency.begin(), adjacency.end(), handle);
+    }
+
+    // Requires a spare capacity.
+    static void insert_sorted(adjacency_t &adjacency, handle_t handle) noexcept {
+        adjacency.insert(std::lower_bound(adjacency.begin(), adjacency.end(), handle), handle);
+    }
+
+    static void erase_sorted(adjacency_t &adjacency, handle_t handle) noexcept {
+        auto it = std::lower_bound(adjacency.begin(), adjacency.end(), handle);
+        if (it != adjacency.end() && *it == handle)
+            adjacency.erase(it);
+    }
+
+    // Constructs the virus in a free slot or in a new one at the end of the arena.
+    handle_t acquire(id_type const &id) {
+        if (!free_slots.empty()) {
+            handle_t handle = free_slots.back();
+            slots[handle].virus.emplace(id);
+            free_slots.pop_back();
+            return handle;
+        }
+
+        if (slots.size() >= std::numeric_limits<handle_t>::max())
+            throw std::length_error("ArenaVirusGenealogy");
+        // Every slot fits in the free list, so that release() does not throw.
+        free_slots.reserve(slots.size() + 1);
+        slots.emplace_back(id);
+        return static_cast<handle_t>(slots.size() - 1);
+    }
+
+    void release(handle_t handle) noexcept {
+        Slot &slot = slots[handle];
+        slot.virus.reset();
+        adjacency_t().swap(slot.parents);
+        adjacency_t().swap(slot.children);
+        free_slots.push_back(handle);
+    }
+
+    // Sorts the (parent, child) edges into the children grouped by the parent, each group sorted, and the list
+    // of the groups as the parent and the end of its children. Edges to a large part of the arena are sorted
+    // by counting, others by comparison.
+    void group_edges(std::vector<std::pair<handle_t, handle_t>> &edges, adjacency_t &children,
+                     std::vector<std::pair<handle_t, std::size_t>> &groups) const {
+        children.clear();
+        groups.clear();
+        children.reserve(edges.size());
+
+        if (edges.size() < slots.size() / 8) {
+            std::sort(edges.begin(), edges.end());
+            for (auto &[parent, child] : edges) {
+                if (!groups.empty() && groups.back().first == parent)
+                    groups.back().second++;
+                else
+                    groups.emplace_back(parent, children.size() + 1);
+                children.push_back(child);
+            }
+            return;
+        }
+
+        std::vector<std::size_t> offsets(slots.size() + 1, 0);
+        for (auto &[parent, child] : edges)
+            offsets[parent + 1]++;
+        for (std::size_t i = 1; i < offsets.size(); i++)
+            offsets[i] += offsets[i - 1];
+
+        children.resize(edges.size());
+        std::vector<std::size_t> next(offsets.begin(), offsets.end() - 1);
+        for (auto &[parent, child] : edges)
+            children[next[parent]++] = child;
+
+        for (std::size_t parent = 0; parent < slots.size(); parent++) {
+            if (offsets[parent] == offsets[parent + 1])
+                continue;
+            std::sort(children.begin() + offsets[parent], children.begin() + offsets[parent + 1]);
+            groups.emplace_back(static_cast<handle_t>(parent), offsets[parent + 1]);
+        }
+    }
+
+    handle_t get_handle(id_type const &id) const {
+        auto it = viruses.find(id);
+
+        if (it == viruses.end())
+            throw VirusNotFound();
+
+        return it->second;
+    }
+
+    const Slot &get_slot(id_type const &id) const {
+        return slots[get_handle(id)];
+    }
+
+public:
+    using children_iterator = ChildrenIterator;
+    using record_type = std::pair<id_type, std::vector<id_type>>;
+
+    ArenaVirusGenealogy(id_type const &stem_id) : stem_id(stem_id) {
+        viruses.emplace(stem_id, acquire(stem_id));
+    }
+
+    ArenaVirusGenealogy(const ArenaVirusGenealogy &other) = delete;
+
+    ArenaVirusGenealogy operator=(const ArenaVirusGenealogy &other) = delete;
+
+    id_type get_stem_id() const {
+        return stem_id;
+    }
+
+    bool exists(id_type const &id) const {
+        return (viruses.contains(id));
+    }
+
+    ArenaVirusGenealogy<Virus>::children_iterator get_children_begin(id_type const &id) const {
+        return ChildrenIterator(&slots, get_slot(id).children.begin());
+    }
+
+    ArenaVirusGenealogy<Virus>::children_iterator get_children_end(id_type const &id) const {
+        return ChildrenIterator(&slots, get_slot(id).children.end());
+    }
+
+    std::vector<id_type> get_parents(id_type const &id) const {
+        const Slot &slot = get_slot(id);
+        std::vector<id_type> res;
+        res.reserve(slot.parents.size());
+
+        for (handle_t parent : slot.parents)
+            res.push_back(slots[parent].virus->get_id());
+
+        return res;
+    }
+
+    const Virus &operator[](id_type const &id) const {
+        return *get_slot(id).virus;
+    };
+
+    void create(id_type const &id, id_type const &parent_id) {
+        create(id, std::vector<id_type>{parent_id});
+    }
+
+    void create(id_type const &id, std::vector<id_type> const &parent_ids) {
+        if (exists(id))
+            throw VirusAlreadyCreated();
+
+        adjacency_t parents;
+        parents.reserve(parent_ids.size());
+        for (auto &parent : parent_ids)
+            parents.push_back(get_handle(parent));
+
+        if (parents.empty())
+            return;
+
+        std::sort(parents.begin(), parents.end());
+        parents.erase(std::unique(parents.begin(), parents.end()), parents.end());
+
+        for (handle_t parent : parents)
+            reserve_one(slots[parent].children);
+
+        SlotGuard guard(this, id);
+        handle_t handle = guard.get();
+        slots[handle].parents.swap(parents);
+        viruses.emplace(id, handle);
+
+        guard.dropRollback();
+        for (handle_t parent : slots[handle].parents)
+            insert_sorted(slots[parent].children, handle);
+    }
+
+    // Has the same effect as create(id, parent_ids) called for all of the records in order, but all or nothing.
+    // The slots of the new viruses are taken while the records are validated and given back on failure, and
+    // the new children of every parent are reserved at once and merged only when nothing can throw any more.
+    void create_bulk(std::vector<record_type> const &records) {
+        map_t created;
+        reserve_index(created, records.size());
+
+        auto find_handle = [&](id_type const &id) -> const handle_t * {
+            auto it = viruses.find(id);
+            if (it != viruses.end())
+                return &it->second;
+            auto created_it = created.find(id);
+            return created_it != created.end() ? &created_it->second : nullptr;
+        };
+
+        std::vector<handle_t> new_handles;
+        std::vector<std::pair<handle_t, handle_t>> edges;
+        adjacency_t new_children;
+        std::vector<std::pair<handle_t, std::size_t>> groups;
+        std::vector<typename map_t::iterator> inserted;
+        new_handles.reserve(records.size());
+
+        try {
+            adjacency_t parents;
+            for (auto &[id, parent_ids] : records) {
+                if (viruses.contains(id) || created.contains(id))
+                    throw VirusAlreadyCreated();
+
+                parents.clear();
+                for (auto &parent : parent_ids) {
+                    const handle_t *handle = find_handle(parent);
+                    if (!handle)
+                        throw VirusNotFound();
+                    parents.push_back(*handle);
+                }
+
+                if (parents.empty())
+                    continue;
+
+                std::sort(parents.begin(), parents.end());
+                parents.erase(std::unique(parents.begin(), parents.end()), parents.end());
+
+                handle_t handle = acquire(id);
+                new_handles.push_back(handle);
+                slots[handle].parents = parents;
+                created.emplace(id, handle);
+
+                for (handle_t parent : parents)
+                    edges.emplace_back(parent, handle);
+            }
+
+            group_edges(edges, new_children, groups);
+            for (std::size_t g = 0, first = 0; g < groups.size(); first = groups[g++].second) {
+                adjacency_t &children = slots[groups[g].first].children;
+                children.reserve(children.size() + (groups[g].second - first));
+            }
+
+            inserted.reserve(new_handles.size());
+            reserve_index(viruses, viruses.size() + new_handles.size());
+            for (handle_t handle : new_handles)
+                inserted.push_back(viruses.emplace(slots[handle].virus->get_id(), handle).first);
+        }
+        catch (...) {
+            for (auto &entry : inserted)
+                viruses.erase(entry);
+            for (handle_t handle : new_handles)
+                release(handle);
+            throw;
+        }
+
+        for (std::size_t g = 0, first = 0; g < groups.size(); first = groups[g++].second) {
+            adjacency_t &children = slots[groups[g].first].children;
+            std::size_t old_size = children.size();
+            children.insert(children.end(), new_children.begin() + first, new_children.begin() + groups[g].second);
+            std::inplace_merge(children.begin(), children.begin() + old_size, children.end());
+        }
+    }
+
+    void create_bulk(std::istream &input) {
+        create_bulk(read_virus_records<id_type>(input));
+    }
+
+    void connect(id_type const &child_id, id_type const &parent_id) {
+        handle_t parent = get_handle(parent_id);
+        handle_t child = get_handle(child_id);
+
+        if (contains(slots[parent].children, child)) return;
+
+        reserve_one(slots[parent].children);
+        reserve_one(slots[child].parents);
+
+        insert_sorted(slots[parent].children, child);
+        insert_sorted(slots[child].parents, parent);
+    }
+
+    void remove(id_type const &id) {
+        handle_t removed_handle = get_handle(id);
+        if (id == stem_id)
+            throw TriedToRemoveStemVirus();
+
+        // Finds the removed viruses, i.e. the given one and the ones left without parents,
+        // along with their entries in the map. Nothing is changed until all of them are known.
+        std::vector<typename map_t::iterator> removed{viruses.find(id)};
+        std::map<handle_t, std::size_t> parents_left{{removed_handle, 0}};
+
+        for (std::size_t i = 0; i < removed.size(); i++) {
+            for (handle_t child : slots[removed[i]->second].children) {
+                auto [it, inserted] = parents_left.emplace(child, slots[child].parents.size());
+                if (--it->second == 0)
+                    removed.push_back(viruses.find(slots[child].virus->get_id()));
+            }
+        }
+
+        auto is_removed = [&](handle_t handle) noexcept {
+            auto it = parents_left.find(handle);
+            return it != parents_left.end() && it->second == 0;
+        };
+
+        for (auto &entry : removed) {
+            handle_t handle = entry->second;
+            for (handle_t parent : slots[handle].parents)
+                if (!is_removed(parent))
+                    erase_sorted(slots[parent].children, handle);
+            for (handle_t child : slots[handle].children)
+                if (!is_removed(child))
+                    erase_sorted(slots[child].parents, handle);
+        }
+
+        for (auto &entry : removed) {
+            handle_t handle = entry->second;
+            viruses.erase(entry);
+            release(handle);
+        }
+    }
+};
+
+#endif // VIRUS_GENEALOGY_ARENA_H
@@ -0,0 +1,370 @@
+#ifndef VIRUS_GENEALOGY_IMAGE_H
+#define VIRUS_GENEALOGY_IMAGE_H
+
+#include <algorithm>
+#include <concepts>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <ostream>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "virus_genealogy.h"
+
+// Compact binary image of a VirusGenealogy with integral ids. All of the numbers are LEB128 varints:
+//   "VGI", format version (1 byte), flags (1 byte, bit 0: payloads present),
+//   number of viruses n, index of the stem virus, number of edges m,
+//   the ids in ascending order: the first one zigzag encoded, then the differences,
+//   the children of every virus in the order of the ids: their number, then the indices of the children
+//   in ascending order, the first one as is, then the differences,
+//   if payloads are present, the payload of every virus in the order of the ids: its size, then the bytes.
+// The payloads are written and read by optional hooks, void(const Virus &, std::string &) appending
+// the payload of a virus and void(Virus &, std::string_view) applying it.
+template<typename Virus>
+class VirusGenealogyImage {
+private:
+    using genealogy_t = VirusGenealogy<Virus>;
+    using id_type = typename Virus::id_type;
+    using node_t = typename genealogy_t::Node;
+    using node_ptr = typename genealogy_t::node_ptr;
+    using unsigned_id = std::make_unsigned_t<id_type>;
+
+    static constexpr char magic[3] = {'V', 'G', 'I'};
+    static constexpr std::uint8_t format_version = 1;
+    static constexpr std::uint8_t has_payloads = 1;
+
+    static void write_varint(std::string &out, std::uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+
+    // Reads the image, throwing std::invalid_argument when it ends too early or is malformed.
+    class Reader {
+    public:
+        explicit Reader(std::span<const char> data) : data(data) {}
+
+        std::uint8_t byte() {
+            if (pos >= data.size())
+                malformed();
+            return static_cast<std::uint8_t>(data[pos++]);
+        }
+
+        std::uint64_t varint() {
+            std::uint64_t value = 0;
+            for (int shift = 0; shift < 64; shift += 7) {
+                std::uint8_t b = byte();
+                value |= static_cast<std::uint64_t>(b & 0x7f) << shift;
+                if (!(b & 0x80))
+                    return value;
+            }
+            malformed();
+        }
+
+        // A count of elements taking at least one byte each, so that nothing is allocated for a bogus one.
+        std::size_t count() {
+            std::uint64_t value = varint();
+            if (value > data.size() - pos)
+                malformed();
+            return static_cast<std::size_t>(value);
+        }
+
+        std::string_view bytes(std::size_t size) {
+            if (size > data.size() - pos)
+                malformed();
+            std::string_view res(data.data() + pos, size);
+            pos += size;
+            return res;
+        }
+
+        bool done() const {
+            return pos == data.size();
+        }
+
+        [[noreturn]] static void malformed() {
+            throw std::invalid_argument("VirusGenealogyImage");
+        }
+
+    private:
+        std::span<const char> data;
+        std::size_t pos = 0;
+    };
+
+    static std::uint64_t zigzag(id_type id) {
+        if constexpr (std::is_signed_v<id_type>)
+            return (static_cast<std::uint64_t>(id) << 1) ^ static_cast<std::uint64_t>(id < 0 ? -1 : 0);
+        else
+            return id;
+    }
+
+    static id_type unzigzag(std::uint64_t value) {
+        if constexpr (std::is_signed_v<id_type>)
+            return static_cast<id_type>((value >> 1) ^ (~(value & 1) + 1));
+        else
+            return static_cast<id_type>(value);
+    }
+
+    // Unmaps the file at the end of the scope.
+    class Mapping {
+    public:
+        Mapping(void *address, std::size_t size) : address(address), size(size) {}
+        Mapping(Mapping const &) = delete;
+        Mapping & operator=(Mapping const &) = delete;
+
+        ~Mapping() noexcept {
+            if (size > 0)
+                munmap(address, size);
+        }
+
+    private:
+        void *address;
+        std::size_t size;
+    };
+
+    // Checks that the edges make a genealogy: the stem is the only virus without parents
+    // and there are no cycles, so that every virus descends from the stem.
+    static void check_genealogy(std::vector<std::size_t> const &offsets, std::vector<std::size_t> const &targets,
+                                std::size_t stem) {
+        std::size_t n = offsets.size() - 1;
+        std::vector<std::size_t> parents_left(n, 0);
+        for (std::size_t target : targets)
+            parents_left[target]++;
+        for (std::size_t i = 0; i < n; i++) {
+            if ((parents_left[i] == 0) != (i == stem))
+                Reader::malformed();
+        }
+
+        std::vector<std::size_t> ready{stem};
+        std::size_t visited = 0;
+        while (!ready.empty()) {
+            std::size_t i = ready.back();
+            ready.pop_back();
+            visited++;
+            for (std::size_t j = offsets[i]; j < offsets[i + 1]; j++) {
+                if (--parents_left[targets[j]] == 0)
+                    ready.push_back(targets[j]);
+            }
+        }
+        if (visited != n)
+            Reader::malformed();
+    }
+
+    struct NoPayload {
+        void operator()(const Virus &, std::string &) const {}
+        void operator()(Virus &, std::string_view) const {}
+    };
+
+public:
+    // Appends the image of the genealogy to out.
+    template<typename SavePayload = NoPayload>
+    static void save(const genealogy_t &genealogy, std::string &out, SavePayload save_payload = {})
+        requires std::integral<id_type> {
+        std::vector<std::pair<id_type, const node_t *>> nodes;
+        nodes.reserve(genealogy.viruses.size());
+        for (auto &entry : genealogy.viruses)
+            nodes.emplace_back(entry.first, entry.second.get());
+        std::sort(nodes.begin(), nodes.end(), [](auto &a, auto &b) { return a.first < b.first; });
+
+        virus_index_t<const node_t *, std::uint64_t> index;
+        reserve_index(index, nodes.size());
+        for (std::size_t i = 0; i < nodes.size(); i++)
+            index.emplace(nodes[i].second, i);
+
+        std::size_t edges = 0;
+        for (auto &[id, node] : nodes)
+            edges += node->children.size();
+
+        bool payloads = !std::is_same_v<SavePayload, NoPayload>;
+        out.append(magic, sizeof(magic));
+        out.push_back(static_cast<char>(format_version));
+        out.push_back(static_cast<char>(payloads ? has_payloads : 0));
+        write_varint(out, nodes.size());
+        write_varint(out, index.find(genealogy.viruses.find(genealogy.stem_id)->second.get())->second);
+        write_varint(out, edges);
+
+        for (std::size_t i = 0; i < nodes.size(); i++) {
+            write_varint(out, i == 0 ? zigzag(nodes[i].first)
+                                     : static_cast<unsigned_id>(static_cast<unsigned_id>(nodes[i].first)
+                                                                - static_cast<unsigned_id>(nodes[i - 1].first)));
+        }
+
+        std::vector<std::uint64_t> children;
+        for (auto &[id, node] : nodes) {
+            children.clear();
+            for (auto &child : node->children)
+                children.push_back(index.find(child.get())->second);
+            std::sort(children.begin(), children.end());
+
+            write_varint(out, children.size());
+            for (std::size_t i = 0; i < children.size(); i++)
+                write_varint(out, i == 0 ? children[i] : children[i] - children[i - 1]);
+        }
+
+        if (payloads) {
+            std::string payload;
+            for (auto &[id, node] : nodes) {
+                payload.clear();
+                save_payload(std::as_const(*node->virus), payload);
+                write_varint(out, payload.size());
+                out += payload;
+            }
+        }
+    }
+
+    template<typename SavePayload = NoPayload>
+    static void save(const genealogy_t &genealogy, std::ostream &out, SavePayload save_payload = {})
+        requires std::integral<id_type> {
+        std::string image;
+        save(genealogy, image, save_payload);
+        if (!out.write(image.data(), static_cast<std::streamsize>(image.size())))
+            throw std::runtime_error("VirusGenealogyImage");
+    }
+
+    // Builds the genealogy from its image, with the nodes and the index allocated at once.
+    // Throws std::invalid_argument if the image is malformed or does not describe a genealogy.
+    template<typename LoadPayload = NoPayload>
+    static std::unique_ptr<genealogy_t> load(std::span<const char> data, LoadPayload load_payload = {})
+        requires std::integral<id_type> {
+        Reader in(data);
+        if (in.bytes(sizeof(magic)) != std::string_view(magic, sizeof(magic)) || in.byte() != format_version)
+            Reader::malformed();
+        std::uint8_t flags = in.byte();
+        std::size_t n = in.count();
+        std::uint64_t stem = in.varint();
+        std::size_t edges = in.count();
+        if (n == 0 || stem >= n)
+            Reader::malformed();
+
+        std::vector<id_type> ids(n);
+        for (std::size_t i = 0; i < n; i++) {
+            std::uint64_t value = in.varint();
+            if (i == 0) {
+                ids[i] = unzigzag(value);
+            }
+            else {
+                if (value == 0 || value > std::numeric_limits<unsigned_id>::max())
+                    Reader::malformed();
+                ids[i] = static_cast<id_type>(static_cast<unsigned_id>(ids[i - 1]) + static_cast<unsigned_id>(value));
+                if (ids[i] <= ids[i - 1])
+                    Reader::malformed();
+            }
+        }
+
+        // The children in a compressed adjacency array: those of the virus i are at [offsets[i], offsets[i + 1]).
+        std::vector<std::size_t> offsets(n + 1);
+        std::vector<std::size_t> targets;
+        targets.reserve(edges);
+        for (std::size_t i = 0; i < n; i++) {
+            std::size_t degree = in.count();
+            if (degree > edges - targets.size())
+                Reader::malformed();
+            for (std::size_t j = 0, child = 0; j < degree; j++) {
+                std::uint64_t value = in.varint();
+                if ((j > 0 && value == 0) || value >= n - child)
+                    Reader::malformed();
+                child += static_cast<std::size_t>(value);
+                if (child == i)
+                    Reader::malformed();
+                targets.push_back(child);
+            }
+            offsets[i + 1] = targets.size();
+        }
+        if (targets.size() != edges)
+            Reader::malformed();
+        check_genealogy(offsets, targets, stem);
+
+        auto genealogy = std::make_unique<genealogy_t>(ids[stem]);
+        std::vector<node_ptr> nodes(n);
+        reserve_index(genealogy->viruses, n);
+        for (std::size_t i = 0; i < n; i++) {
+            if (i == stem) {
+                nodes[i] = genealogy->viruses.find(ids[i])->second;
+            }
+            else {
+                nodes[i] = std::make_shared<node_t>(ids[i]);
+                genealogy->viruses.emplace(ids[i], nodes[i]);
+            }
+        }
+
+        // The parents in the same way, so that both sets of every virus are filled in the order of the set,
+        // with every insertion at its end.
+        std::vector<std::size_t> parents_offsets(n + 1, 0);
+        std::vector<std::size_t> sources(edges);
+        for (std::size_t target : targets)
+            parents_offsets[target + 1]++;
+        for (std::size_t i = 0; i < n; i++)
+            parents_offsets[i + 1] += parents_offsets[i];
+        std::vector<std::size_t> next(parents_offsets.begin(), parents_offsets.end() - 1);
+        for (std::size_t i = 0; i < n; i++) {
+            for (std::size_t j = offsets[i]; j < offsets[i + 1]; j++)
+                sources[next[targets[j]]++] = i;
+        }
+
+        auto fill = [&](typename node_t::set_t &set, std::vector<std::size_t> const &neighbours,
+                        std::size_t begin, std::size_t end, std::vector<node_ptr> &buffer) {
+            buffer.clear();
+            for (std::size_t j = begin; j < end; j++)
+                buffer.push_back(nodes[neighbours[j]]);
+            std::sort(buffer.begin(), buffer.end());
+            for (auto &node : buffer)
+                set.emplace_hint(set.end(), node);
+        };
+        std::vector<node_ptr> buffer;
+        for (std::size_t i = 0; i < n; i++) {
+            fill(nodes[i]->children, targets, offsets[i], offsets[i + 1], buffer);
+            fill(nodes[i]->parents, sources, parents_offsets[i], parents_offsets[i + 1], buffer);
+        }
+
+        if (flags & has_payloads) {
+            for (std::size_t i = 0; i < n; i++) {
+                std::string_view payload = in.bytes(in.count());
+                if constexpr (!std::is_same_v<LoadPayload, NoPayload>)
+                    load_payload(*nodes[i]->virus, payload);
+            }
+        }
+        if (!in.done())
+            Reader::malformed();
+
+        return genealogy;
+    }
+
+    // Maps the file into memory and builds the genealogy from it.
+    template<typename LoadPayload = NoPayload>
+    static std::unique_ptr<genealogy_t> load_file(const std::string &path, LoadPayload load_payload = {})
+        requires std::integral<id_type> {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw std::system_error(errno, std::generic_category(), path);
+
+        struct stat info;
+        if (fstat(fd, &info) < 0) {
+            int error = errno;
+            close(fd);
+            throw std::system_error(error, std::generic_category(), path);
+        }
+
+        std::size_t size = static_cast<std::size_t>(info.st_size);
+        void *address = size > 0 ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+        int error = errno;
+        close(fd);
+        if (address == MAP_FAILED)
+            throw std::system_error(error, std::generic_category(), path);
+
+        Mapping mapping(address, size);
+        return load(std::span<const char>(static_cast<const char *>(address), size), load_payload);
+    }
+};
+
+#endif // VIRUS_GENEALOGY_IMAGE_H
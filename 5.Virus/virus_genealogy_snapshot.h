@@ -0,0 +1,259 @@
+#ifndef VIRUS_GENEALOGY_SNAPSHOT_H
+#define VIRUS_GENEALOGY_SNAPSHOT_H
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "virus_genealogy.h"
+#include "virus_index.h"
+
+// Immutable version of a VirusGenealogy, with the read-only part of its interface.
+// The parents and the children of all of the viruses are kept in two compressed adjacency
+// arrays, and the viruses are shared with the genealogy, so a snapshot stays valid and
+// consistent after any change of the genealogy, and can be read by any number of threads.
+template<typename Virus>
+class VirusGenealogySnapshot {
+private:
+    using id_type = typename Virus::id_type;
+    using index_t = std::uint32_t;
+    using map_t = virus_index_t<id_type, index_t>;
+
+    id_type stem_id;
+    map_t index;
+    std::vector<std::shared_ptr<const Virus>> viruses;
+    // The neighbours of the virus i are at [offsets[i], offsets[i + 1]).
+    std::vector<std::size_t> children_offsets, parents_offsets;
+    std::vector<index_t> children, parents;
+
+    class ChildrenIterator {
+    private:
+        const VirusGenealogySnapshot *snapshot = nullptr;
+        typename std::vector<index_t>::const_iterator it;
+
+    public:
+        using iterator_category = std::bidirectional_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = Virus;
+        using pointer = const value_type *;
+        using reference = const value_type &;
+
+        ChildrenIterator() = default;
+        ChildrenIterator(const VirusGenealogySnapshot *snapshot, typename std::vector<index_t>::const_iterator iter)
+            : snapshot(snapshot), it(iter) {}
+
+        reference operator*() const {
+            return *snapshot->viruses[*it];
+        }
+
+        pointer operator->() const {
+            return snapshot->viruses[*it].get();
+        }
+
+        ChildrenIterator &operator++() {
+            it++;
+            return *this;
+        }
+
+        ChildrenIterator operator++(int) {
+            ChildrenIterator result(*this);
+            operator++();
+            return result;
+        }
+
+        ChildrenIterator &operator--() {
+            it--;
+            return *this;
+        }
+
+        ChildrenIterator operator--(int) {
+            ChildrenIterator result(*this);
+            operator--();
+            return result;
+        }
+
+        bool operator==(const ChildrenIterator &other) const { return it == other.it; };
+        bool operator!=(const ChildrenIterator &other) const { return it != other.it; };
+    };
+
+    index_t get_index(id_type const &id) const {
+        auto it = index.find(id);
+
+        if (it == index.end())
+            throw VirusNotFound();
+
+        return it->second;
+    }
+
+public:
+    using children_iterator = ChildrenIterator;
+
+    // Copies the structure of the genealogy, in O(viruses + edges).
+    explicit VirusGenealogySnapshot(const VirusGenealogy<Virus> &genealogy) : stem_id(genealogy.stem_id) {
+        std::size_t count = genealogy.viruses.size();
+        viruses.reserve(count);
+        for (auto &entry : genealogy.viruses) {
+            index.emplace(entry.first, static_cast<index_t>(viruses.size()));
+            viruses.push_back(entry.second->virus);
+        }
+
+        children_offsets.reserve(count + 1);
+        parents_offsets.reserve(count + 1);
+        children_offsets.push_back(0);
+        parents_offsets.push_back(0);
+        for (auto &entry : genealogy.viruses) {
+            for (auto &child : entry.second->children)
+                children.push_back(index.find(child->virus->get_id())->second);
+            for (auto &parent : entry.second->parents)
+                parents.push_back(index.find(parent->virus->get_id())->second);
+            children_offsets.push_back(children.size());
+            parents_offsets.push_back(parents.size());
+        }
+    }
+
+    VirusGenealogySnapshot(const VirusGenealogySnapshot &other) = delete;
+
+    VirusGenealogySnapshot operator=(const VirusGenealogySnapshot &other) = delete;
+
+    id_type get_stem_id() const {
+        return stem_id;
+    }
+
+    bool exists(id_type const &id) const {
+        return (index.contains(id));
+    }
+
+    VirusGenealogySnapshot<Virus>::children_iterator get_children_begin(id_type const &id) const {
+        return ChildrenIterator(this, children.begin() + children_offsets[get_index(id)]);
+    }
+
+    VirusGenealogySnapshot<Virus>::children_iterator get_children_end(id_type const &id) const {
+        return ChildrenIterator(this, children.begin() + children_offsets[get_index(id) + 1]);
+    }
+
+    std::vector<id_type> get_parents(id_type const &id) const {
+        index_t i = get_index(id);
+        std::vector<id_type> res;
+        res.reserve(parents_offsets[i + 1] - parents_offsets[i]);
+
+        for (std::size_t j = parents_offsets[i]; j < parents_offsets[i + 1]; j++)
+            res.push_back(viruses[parents[j]]->get_id());
+
+        return res;
+    }
+
+    const Virus &operator[](id_type const &id) const {
+        return *viruses[get_index(id)];
+    };
+};
+
+// VirusGenealogy shared by writer threads and reader threads. The writers change the genealogy
+// under a mutex and append every change that succeeded to a log. publish() takes the log under
+// that mutex in O(1), replays it on a replica of the genealogy changed only by publish(), in O(changes),
+// and copies the replica into a new snapshot in O(viruses + edges), all without blocking the writers.
+// The readers take the last published snapshot with snapshot() and then read it without
+// synchronization, for as long as they hold it. A snapshot is freed when the last reader drops it.
+//
+// Every virus is kept both in the genealogy and in the replica. snapshot() and publish() go through
+// std::atomic<std::shared_ptr>, which in libstdc++ takes a short internal lock, so taking a snapshot
+// is not lock-free, only reading it is.
+template<typename Virus>
+class ConcurrentVirusGenealogy {
+private:
+    using id_type = typename Virus::id_type;
+    using genealogy_t = VirusGenealogy<Virus>;
+    using snapshot_ptr = std::shared_ptr<const VirusGenealogySnapshot<Virus>>;
+    // A change of the genealogy, replayed on the replica.
+    using change_t = std::function<void(genealogy_t &)>;
+
+    std::mutex write_mutex;
+    genealogy_t genealogy;
+    std::vector<change_t> log;
+
+    std::mutex publish_mutex;
+    genealogy_t replica;
+    // The changes taken from the log and not replayed yet, if the replay threw.
+    std::vector<change_t> pending;
+    std::atomic<snapshot_ptr> published;
+
+    // Makes the change on the genealogy and appends it to the log. The log is reserved first,
+    // so that the change is logged if and only if it succeeds.
+    void write(change_t change) {
+        std::lock_guard lock(write_mutex);
+        log.reserve(log.size() + 1);
+        change(genealogy);
+        log.push_back(std::move(change));
+    }
+
+public:
+    ConcurrentVirusGenealogy(id_type const &stem_id) : genealogy(stem_id), replica(stem_id) {
+        published.store(std::make_shared<const VirusGenealogySnapshot<Virus>>(replica));
+    }
+
+    ConcurrentVirusGenealogy(const ConcurrentVirusGenealogy &other) = delete;
+
+    ConcurrentVirusGenealogy operator=(const ConcurrentVirusGenealogy &other) = delete;
+
+    id_type get_stem_id() const {
+        return genealogy.get_stem_id();
+    }
+
+    snapshot_ptr snapshot() const {
+        return published.load(std::memory_order_acquire);
+    }
+
+    void create(id_type const &id, id_type const &parent_id) {
+        write([id, parent_id](genealogy_t &g) { g.create(id, parent_id); });
+    }
+
+    void create(id_type const &id, std::vector<id_type> const &parent_ids) {
+        write([id, parent_ids](genealogy_t &g) { g.create(id, parent_ids); });
+    }
+
+    void create_bulk(std::vector<typename genealogy_t::record_type> const &records) {
+        write([records](genealogy_t &g) { g.create_bulk(records); });
+    }
+
+    void connect(id_type const &child_id, id_type const &parent_id) {
+        write([child_id, parent_id](genealogy_t &g) { g.connect(child_id, parent_id); });
+    }
+
+    void remove(id_type const &id) {
+        write([id](genealogy_t &g) { g.remove(id); });
+    }
+
+    // Makes the changes made so far visible to the readers. The writers are blocked only while
+    // the log is taken. The changes succeeded on the genealogy in the same order, so replaying them
+    // can only throw bad_alloc, and then they are kept for the next call and the previous snapshot
+    // stays published.
+    void publish() {
+        std::lock_guard publish_lock(publish_mutex);
+        {
+            std::lock_guard lock(write_mutex);
+            if (pending.empty())
+                pending.swap(log);
+            else {
+                pending.insert(pending.end(), std::make_move_iterator(log.begin()), std::make_move_iterator(log.end()));
+                log.clear();
+            }
+        }
+
+        std::size_t replayed = 0;
+        try {
+            for (; replayed < pending.size(); replayed++)
+                pending[replayed](replica);
+        }
+        catch (...) {
+            pending.erase(pending.begin(), pending.begin() + static_cast<std::ptrdiff_t>(replayed));
+            throw;
+        }
+        pending.clear();
+
+        published.store(std::make_shared<const VirusGenealogySnapshot<Virus>>(replica), std::memory_order_release);
+    }
+};
+
+#endif // VIRUS_GENEALOGY_SNAPSHOT_H
@@ -0,0 +1,268 @@
+#ifndef VIRUS_INDEX_H
+#define VIRUS_INDEX_H
+
+#include <algorithm>
+#include <bit>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Open addressing hash table with linear probing, with the part of the interface of std::map
+// used by the genealogies. Erased entries leave tombstones, so erase() does not move the other
+// entries and does not invalidate iterators to them, as in std::map. emplace() may rehash and
+// then invalidates all iterators, but gives the strong exception guarantee.
+template<typename Key, typename Value>
+class FlatHashIndex {
+public:
+    using key_type = Key;
+    using mapped_type = Value;
+    using value_type = std::pair<const Key, Value>;
+
+private:
+    struct Slot {
+        std::optional<value_type> entry;
+        bool tombstone = false;
+    };
+
+    std::vector<Slot> slots;
+    std::size_t live = 0;
+    // Entries and tombstones.
+    std::size_t used = 0;
+    int shift = 64;
+
+    static constexpr std::size_t min_capacity = 16;
+
+    template<bool Const>
+    class Iterator {
+    private:
+        using slot_ptr = std::conditional_t<Const, const Slot *, Slot *>;
+
+        slot_ptr slot = nullptr;
+        slot_ptr last = nullptr;
+
+        void skip() {
+            while (slot != last && !slot->entry)
+                slot++;
+        }
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using difference_type = std::ptrdiff_t;
+        using value_type = FlatHashIndex::value_type;
+        using pointer = std::conditional_t<Const, const value_type *, value_type *>;
+        using reference = std::conditional_t<Const, const value_type &, value_type &>;
+
+        Iterator() = default;
+        Iterator(slot_ptr slot, slot_ptr last) : slot(slot), last(last) {
+            skip();
+        }
+        template<bool OtherConst> requires (Const && !OtherConst)
+        Iterator(const Iterator<OtherConst> &other) : slot(other.slot), last(other.last) {}
+
+        reference operator*() const {
+            return *slot->entry;
+        }
+
+        pointer operator->() const {
+            return &*slot->entry;
+        }
+
+        Iterator &operator++() {
+            slot++;
+            skip();
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator result(*this);
+            operator++();
+            return result;
+        }
+
+        bool operator==(const Iterator &other) const { return slot == other.slot; };
+        bool operator!=(const Iterator &other) const { return slot != other.slot; };
+
+        friend class FlatHashIndex;
+        friend class Iterator<!Const>;
+    };
+
+    // Fibonacci hashing, so that the identity hashes of the integers are spread over the table.
+    std::size_t home(const Key &key) const {
+        return static_cast<std::size_t>((std::hash<Key>{}(key) * UINT64_C(0x9E3779B97F4A7C15)) >> shift);
+    }
+
+    std::size_t next(std::size_t index) const noexcept {
+        return (index + 1) & (slots.size() - 1);
+    }
+
+    // Index of the entry with the key, or slots.size() if there is none.
+    std::size_t find_index(const Key &key) const {
+        if (live == 0)
+            return slots.size();
+
+        for (std::size_t i = home(key);; i = next(i)) {
+            const Slot &slot = slots[i];
+            if (slot.entry) {
+                if (slot.entry->first == key)
+                    return i;
+            }
+            else if (!slot.tombstone) {
+                return slots.size();
+            }
+        }
+    }
+
+    // Moves the entries to a new table of the given power of two capacity, without tombstones.
+    // The keys are const, so they are copied, and the values are moved only when the keys cannot
+    // throw, so that an exception leaves the table intact.
+    void rehash(std::size_t capacity) {
+        FlatHashIndex res;
+        res.slots.resize(capacity);
+        res.shift = 64 - std::countr_zero(capacity);
+
+        for (auto &slot : slots) {
+            if (!slot.entry)
+                continue;
+            std::size_t i = res.home(slot.entry->first);
+            while (res.slots[i].entry)
+                i = res.next(i);
+            if constexpr (std::is_nothrow_copy_constructible_v<Key>)
+                res.slots[i].entry.emplace(slot.entry->first, std::move_if_noexcept(slot.entry->second));
+            else
+                res.slots[i].entry.emplace(slot.entry->first, std::as_const(slot.entry->second));
+            res.live++;
+        }
+        res.used = res.live;
+
+        swap(res);
+    }
+
+public:
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    FlatHashIndex() = default;
+    FlatHashIndex(const FlatHashIndex &other) = default;
+    FlatHashIndex(FlatHashIndex &&other) noexcept { swap(other); }
+
+    FlatHashIndex &operator=(FlatHashIndex other) noexcept {
+        swap(other);
+        return *this;
+    }
+
+    void swap(FlatHashIndex &other) noexcept {
+        slots.swap(other.slots);
+        std::swap(live, other.live);
+        std::swap(used, other.used);
+        std::swap(shift, other.shift);
+    }
+
+    iterator begin() { return iterator(slots.data(), slots.data() + slots.size()); }
+    iterator end() { return iterator(slots.data() + slots.size(), slots.data() + slots.size()); }
+    const_iterator begin() const { return const_iterator(slots.data(), slots.data() + slots.size()); }
+    const_iterator end() const { return const_iterator(slots.data() + slots.size(), slots.data() + slots.size()); }
+
+    std::size_t size() const noexcept { return live; }
+    bool empty() const noexcept { return live == 0; }
+
+    // Makes room for count entries, so that the insertions up to that size do not rehash
+    // and do not invalidate iterators.
+    void reserve(std::size_t count) {
+        std::size_t capacity = min_capacity;
+        while (capacity / 2 < count)
+            capacity *= 2;
+        std::size_t used_after = used + (count > live ? count - live : 0);
+        if (capacity > slots.size() || used_after * 8 > slots.size() * 7)
+            rehash(std::max(capacity, slots.size()));
+    }
+
+    iterator find(const Key &key) {
+        return iterator(slots.data() + find_index(key), slots.data() + slots.size());
+    }
+
+    const_iterator find(const Key &key) const {
+        return const_iterator(slots.data() + find_index(key), slots.data() + slots.size());
+    }
+
+    bool contains(const Key &key) const {
+        return find_index(key) != slots.size();
+    }
+
+    template<typename... Args>
+    std::pair<iterator, bool> emplace(const Key &key, Args &&... args) {
+        iterator it = find(key);
+        if (it != end())
+            return {it, false};
+
+        // At most 7/8 of the table is used, at most a half after a rehash.
+        if ((used + 1) * 8 > slots.size() * 7)
+            rehash(std::max(min_capacity, std::bit_ceil(2 * (live + 1))));
+
+        std::size_t i = home(key);
+        while (slots[i].entry)
+            i = next(i);
+        slots[i].entry.emplace(std::piecewise_construct, std::forward_as_tuple(key),
+                               std::forward_as_tuple(std::forward<Args>(args)...));
+        if (!slots[i].tombstone)
+            used++;
+        slots[i].tombstone = false;
+        live++;
+
+        return {iterator(slots.data() + i, slots.data() + slots.size()), true};
+    }
+
+    void erase(const_iterator pos) noexcept {
+        Slot &slot = slots[pos.slot - slots.data()];
+        slot.entry.reset();
+        slot.tombstone = true;
+        live--;
+    }
+
+    std::size_t erase(const Key &key) {
+        std::size_t i = find_index(key);
+        if (i == slots.size())
+            return 0;
+        erase(const_iterator(slots.data() + i, slots.data() + slots.size()));
+        return 1;
+    }
+
+    void clear() noexcept {
+        for (auto &slot : slots) {
+            slot.entry.reset();
+            slot.tombstone = false;
+        }
+        live = used = 0;
+    }
+};
+
+// Makes room for the given number of entries, if the index supports it.
+template<typename Index>
+void reserve_index(Index &index, std::size_t count) {
+    if constexpr (requires { index.reserve(count); })
+        index.reserve(count);
+}
+
+template<typename Key>
+concept hash_indexable = requires(const Key &key) {
+    { std::hash<Key>{}(key) } -> std::convertible_to<std::size_t>;
+};
+
+// Index of the viruses by id: the hash table when the ids can be hashed and VIRUS_GENEALOGY_ORDERED_INDEX
+// is not defined, std::map otherwise.
+#ifdef VIRUS_GENEALOGY_ORDERED_INDEX
+template<typename Key, typename Value>
+using virus_index_t = std::map<Key, Value>;
+#else
+template<typename Key, typename Value>
+using virus_index_t = std::conditional_t<hash_indexable<Key>, FlatHashIndex<Key, Value>, std::map<Key, Value>>;
+#endif
+
+#endif // VIRUS_INDEX_H